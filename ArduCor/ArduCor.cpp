@@ -14,6 +14,8 @@
 
 #include "ArduCor.h"
 #include "Palettes.h"
+#include "Gamma.h"
+#include "Sine.h"
 
 // Default brightness of LEDS, must be a value between 0 and 100.
 const uint8_t  DEFAULT_BRIGHTNESS  = 50;
@@ -21,7 +23,7 @@ const uint8_t  DEFAULT_BRIGHTNESS  = 50;
 // value leads to quicker fades.
 const uint8_t  DEFAULT_FADE_SPEED = 100;
 // used for determining how fast blink routines are. This is how many
-// frames it waits until switching the LED states from on or off.
+// steps it waits until switching the LED states from on or off.
 // a lower number speeds up the blink.
 const uint8_t  DEFAULT_BLINK_SPEED = 3;
 // default value that determines how many colors a custom color routine should use.
@@ -31,76 +33,232 @@ const uint8_t  DEFAULT_CUSTOM_COUNT = 2;
 // of the same color in routines that display multiple colors or multiple
 // shares of the same color.
 const uint8_t  DEFAULT_BAR_SIZE = 2;
+// default time of a step of a routine that is run with the elapsed time, in milliseconds.
+const uint16_t DEFAULT_STEP_INTERVAL = 50;
+// seed used by the random number generator until seedRandom() is called. Any
+// nonzero value works.
+const uint32_t DEFAULT_RANDOM_SEED = 0x2545F491;
+// number of LEDs drawn and dimmed together when a frame is drawn in chunks. A chunk of an
+// interleaved frame fits easily in the cache of a desktop, so the second pass over it is cheap.
+const uint16_t RENDER_CHUNK_SIZE = 256;
+// singleWave stores each level of its wave in a byte, so longer waves use wider steps.
+const uint16_t MAX_WAVE_LEVELS = 256;
+// number of LEDs blended at a time when copyFrame() blends the layers. Each chunk of a layer
+// is copied onto the stack, so it is kept small enough for an AVR.
+const uint16_t LAYER_CHUNK_SIZE = 32;
+// number of colors in the gradient built by paletteGradient(), one for each value of a byte.
+const uint16_t GRADIENT_SIZE = 256;
 
 //================================================================================
-// Constructors
+// Static Helpers
 //================================================================================
 
-ArduCor::ArduCor(uint16_t ledCount)
+/*!
+ * Maps every `stride`th value in the buffer through the brightness table, then scales it
+ * by the white balance value of the channel. Takes its arguments as locals so the compiler
+ * doesn't need to reload them after each write to the buffer.
+ */
+static void
+applyBrightnessTable(uint8_t *buffer, const uint8_t *table, uint8_t whiteBalance, size_t count, uint8_t stride)
 {
-    m_LED_count = ledCount;
-    // catch an illegal argument
-    if (m_LED_count == 0) {
-        m_LED_count = 1;
+    size_t end = count * stride;
+    if (whiteBalance == 255) {
+        for (size_t i = 0; i < end; i += stride) {
+            buffer[i] = table[buffer[i]];
+        }
+    } else {
+        // (value * (whiteBalance + 1)) >> 8 avoids a divide by 255
+        uint16_t scale = (uint16_t)whiteBalance + 1;
+        for (size_t i = 0; i < end; i += stride) {
+            buffer[i] = (uint8_t)((table[buffer[i]] * scale) >> 8);
+        }
     }
+}
+
+/*!
+ * Same mapping as applyBrightnessTable, for a single value.
+ */
+static uint8_t
+applyBrightnessValue(const uint8_t *table, uint8_t whiteBalance, uint8_t value)
+{
+    return (uint8_t)((table[value] * ((uint16_t)whiteBalance + 1)) >> 8);
+}
+
+/*!
+ * Scales a value by a 16 bit fraction, where 65536 leaves the value unchanged. The fade
+ * routines compute the fraction once per frame, so each channel costs a multiply and a shift.
+ */
+static uint8_t
+scaleChannel(uint8_t value, uint32_t scale)
+{
+    return (uint8_t)((value * scale) >> 16);
+}
+
+/*!
+ * Blends between two values by a 16 bit fraction, where 0 returns `from` and 65536
+ * returns `to`.
+ */
+static uint8_t
+blendChannel(uint8_t from, uint8_t to, uint32_t scale)
+{
+    return (uint8_t)((from * (65536 - scale) + to * scale) >> 16);
+}
 
-    // allocate the arrays not known at runtime.
-    if((r_buffer = (uint8_t*)malloc(ledCount))) {
-        memset(r_buffer, 0, ledCount);
+/*!
+ * Blends `size` bytes of a layer onto the frame below it. Each blend mode has its own loop,
+ * so the inner loops only do 8 bit math with 16 bit intermediates. The opacity is applied
+ * as `(value * (opacity + 1)) >> 8`, which avoids a divide by 255.
+ */
+static void
+blendLayer(uint8_t *below, const uint8_t *layer, size_t size, ArduCor::EBlendMode mode, uint8_t opacity)
+{
+    uint16_t weight = (uint16_t)opacity + 1;
+    switch (mode) {
+        case ArduCor::eBlendAdd:
+            for (size_t i = 0; i < size; ++i) {
+                uint16_t value = below[i] + (((uint16_t)layer[i] * weight) >> 8);
+                below[i] = (value > 255) ? 255 : (uint8_t)value;
+            }
+            break;
+        case ArduCor::eBlendMax:
+            for (size_t i = 0; i < size; ++i) {
+                uint8_t value = (uint8_t)(((uint16_t)layer[i] * weight) >> 8);
+                if (value > below[i]) {
+                    below[i] = value;
+                }
+            }
+            break;
+        case ArduCor::eBlendAlpha:
+            for (size_t i = 0; i < size; ++i) {
+                below[i] = (uint8_t)(((uint16_t)below[i] * (256 - weight) + (uint16_t)layer[i] * weight) >> 8);
+            }
+            break;
+        case ArduCor::eBlendMultiply:
+            for (size_t i = 0; i < size; ++i) {
+                uint8_t product = (uint8_t)(((uint16_t)below[i] * ((uint16_t)layer[i] + 1)) >> 8);
+                below[i] = (uint8_t)(((uint16_t)below[i] * (256 - weight) + (uint16_t)product * weight) >> 8);
+            }
+            break;
     }
+}
 
-    if((g_buffer = (uint8_t*)malloc(ledCount))) {
-        memset(g_buffer, 0, ledCount);
+/*!
+ * Gets the fraction of `counter` out of `period` as a 16 bit fraction. A counter past the
+ * period is clamped to the full value.
+ */
+static uint32_t
+fadeScale(uint16_t counter, uint16_t period)
+{
+    if (counter >= period) {
+        return 65536;
     }
+    return ((uint32_t)counter << 16) / period;
+}
+
+/*!
+ * Looks up the sine fade curve `counter / period` of the way through a cycle. The position
+ * is kept in 8.8 fixed point, where the integer part picks an entry of sineCurve and the
+ * fraction interpolates towards the next one.
+ */
+static uint32_t
+sineScale(uint16_t counter, uint16_t period)
+{
+    uint32_t position = ((uint32_t)counter << 16) / period;
+    uint8_t  i = (position >> 8) & 0xFF;
+    uint32_t fraction = position & 0xFF;
+    uint32_t a = pgm_read_word_near(sineCurve + i);
+    uint32_t b = pgm_read_word_near(sineCurve + i + 1);
+    return (a * (256 - fraction) + b * fraction) >> 8;
+}
 
-    if((b_buffer = (uint8_t*)malloc(ledCount))) {
-        memset(b_buffer, 0, ledCount);
+/*!
+ * Gets the position of each channel within the three bytes of an LED for a channel order.
+ */
+static void
+channelOffsets(ArduCor::EColorOrder order, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    if (order == ArduCor::eOrderGRB) {
+        *r = 1; *g = 0; *b = 2;
+    } else if (order == ArduCor::eOrderBGR) {
+        *r = 2; *g = 1; *b = 0;
+    } else {
+        *r = 0; *g = 1; *b = 2;
     }
+}
 
-    if((m_temp_buffer = (uint8_t*)malloc(ledCount))) {
-        memset(m_temp_buffer, 0, ledCount);
+/*!
+ * Crossfades `count` LEDs of the new frame towards the old frame of a transition, stored in
+ * RGB order, with a fixed point lerp. A `weight` of 256 shows only the old frame.
+ */
+static void
+blendTransition(uint8_t *destination, const uint8_t *previous, ArduCor::LEDIndex count, ArduCor::EColorOrder order, uint16_t weight)
+{
+    uint8_t offsets[3];
+    channelOffsets(order, &offsets[0], &offsets[1], &offsets[2]);
+    uint16_t keep = 256 - weight;
+    for (ArduCor::LEDIndex i = 0; i < count; ++i) {
+        for (uint8_t c = 0; c < 3; ++c) {
+            uint8_t *value = destination + offsets[c];
+            *value = (uint8_t)(((uint16_t)*value * keep + (uint16_t)previous[c] * weight) >> 8);
+        }
+        destination += 3;
+        previous += 3;
     }
+}
+
+//================================================================================
+// Constructors
+//================================================================================
 
+ArduCor::ArduCor(LEDIndex ledCount)
+{
+    setupBuffers(ledCount, false, eOrderRGB);
+    seedRandom(DEFAULT_RANDOM_SEED);
     // all colors gets set before use since it changes each times
     resetToDefaults();
 }
 
-void ArduCor::resetToDefaults()
+ArduCor::ArduCor(LEDIndex ledCount, EColorOrder order)
 {
-    // By default, this is set to orange. However,
-    // most sample sketches will override this value
-    // during their setup.
-    m_main_color = {100, 25, 0};
+    setupBuffers(ledCount, true, order);
+    seedRandom(DEFAULT_RANDOM_SEED);
+    // all colors gets set before use since it changes each times
+    resetToDefaults();
+}
 
-    // set user configurable settings
-    m_current_palette = eCustom;
-    m_current_routine = eSingleGlimmer;
+ArduCor::ArduCor(LEDIndex ledCount, bool interleaved, EColorOrder order, uint8_t *frameStorage, uint8_t *tempStorage)
+{
+    setupBuffers(ledCount, interleaved, order, frameStorage, tempStorage);
+    seedRandom(DEFAULT_RANDOM_SEED);
+    // all colors gets set before use since it changes each times
+    resetToDefaults();
+}
+
+ArduCor::~ArduCor()
+{
+    if (m_owns_strip_buffer) {
+        free(m_strip_buffer);
+    }
+    if (m_owns_temp_storage) {
+        free(m_temp_storage);
+    }
+    free(m_segments);
+    free(m_transition_buffer);
+    free(m_gradient);
+}
 
-    brightness(DEFAULT_BRIGHTNESS);
+void ArduCor::resetToDefaults()
+{
+    m_gamma_enabled = false;
+    m_white_balance = {255, 255, 255};
+    m_bright_level = DEFAULT_BRIGHTNESS;
+    buildBrightnessTable();
     m_fade_speed   = DEFAULT_FADE_SPEED;
     m_blink_speed  = DEFAULT_BLINK_SPEED;
     m_custom_count = DEFAULT_CUSTOM_COUNT;
-    m_bar_size     = DEFAULT_BAR_SIZE;
-    // edge case for smaller LED arrays, rather than using multiple LEDs in a "bar"
-    // it defaults to one LED per bar.
-    if (m_LED_count < 32) {
-        m_bar_size = 1;
-    }
-
-    // set temp values
-    m_temp_index = 0;
-    m_temp_counter = 0;
-    m_temp_bool = true;
-    m_temp_color = {0, 0, 0};
-    m_scale_factor = 0;
-    m_temp_float = 0.0f;
-    m_temp_step = 0;
-    m_temp_goal = 0;
-    m_possible_array_color = 0;
-    m_is_on = true;
-
-    // set routine specific variables
-    m_goal_color = {0, 0, 0};
+    // the copies of the custom colors are made again
+    m_temp_palette = ePalette_MAX;
+    m_gradient_palette = ePalette_MAX;
 
     // set custom colors to default colors
     for (x = 0; x < 10; x = x + 5) {
@@ -110,6 +268,14 @@ void ArduCor::resetToDefaults()
         m_custom_colors[x + 3] = {40,  127, 40};    // light green
         m_custom_colors[x + 4] = {60,  0,   160};   // purple
     }
+
+    // reset the routine of every segment
+    uint8_t selected = m_segment_index;
+    for (uint8_t i = 0; i < segmentCount(); ++i) {
+        selectSegment(i);
+        resetSegment();
+    }
+    selectSegment(selected);
 }
 
 
@@ -125,6 +291,11 @@ ArduCor::setMainColor(uint8_t r, uint8_t g, uint8_t b)
         && (m_main_color.blue == b)) {
         return false;
     } else {
+        // singleWave draws its pattern with the main color, so the current frame is put in
+        // place with the old color and the pattern is drawn again on the next frame.
+        if (m_current_routine == eSingleWave) {
+            resolveRotation();
+        }
         m_main_color = {r, g, b};
         return true;
     }
@@ -134,11 +305,14 @@ void
 ArduCor::setColor(uint16_t colorIndex, uint8_t r, uint8_t g, uint8_t b)
 {
     if (colorIndex < (sizeof(m_custom_colors) / sizeof(Color))) {
-        m_custom_colors[colorIndex] = {r, g, b};
-        // catch edge case
-        if (m_current_palette == eCustom) {
-            m_preprocess_flag = true;
+        // controllers often send the whole array again, so an unchanged color doesn't
+        // make the routines start over.
+        const Color& color = m_custom_colors[colorIndex];
+        if ((color.red == r) && (color.green == g) && (color.blue == b)) {
+            return;
         }
+        invalidateCustomPalette();
+        m_custom_colors[colorIndex] = {r, g, b};
     }
 }
 
@@ -146,12 +320,9 @@ ArduCor::setColor(uint16_t colorIndex, uint8_t r, uint8_t g, uint8_t b)
 void
 ArduCor::setCustomColorCount(uint8_t count)
 {
-    if (count != 0) {
+    if ((count != 0) && (count != m_custom_count)) {
+        invalidateCustomPalette();
         m_custom_count = count;
-        // catch edge case
-        if (m_current_palette == eCustom) {
-            m_preprocess_flag = true;
-        }
     }
 }
 
@@ -164,14 +335,37 @@ ArduCor::customColorCount()
 void
 ArduCor::brightness(uint8_t brightness)
 {
-    if (brightness <= 100) {
+    // an unchanged value leaves the frames as they are
+    if ((brightness <= 100) && (m_bright_level != brightness)) {
         m_bright_level = brightness;
-        m_brightness_flag = true;
+        buildBrightnessTable();
+        invalidateBrightness();
+    }
+}
+
+void
+ArduCor::gammaCorrection(bool enabled)
+{
+    if (m_gamma_enabled != enabled) {
+        m_gamma_enabled = enabled;
+        buildBrightnessTable();
+        invalidateBrightness();
+    }
+}
+
+void
+ArduCor::whiteBalance(uint8_t r, uint8_t g, uint8_t b)
+{
+    if ((m_white_balance.red != r)
+        || (m_white_balance.green != g)
+        || (m_white_balance.blue != b)) {
+        m_white_balance = {r, g, b};
+        invalidateBrightness();
     }
 }
 
 void
-ArduCor::barSize(uint8_t barSize)
+ArduCor::barSize(uint16_t barSize)
 {
     if ((barSize != 0)
         && (barSize < m_LED_count)
@@ -181,6 +375,16 @@ ArduCor::barSize(uint8_t barSize)
     }
 }
 
+void
+ArduCor::stepInterval(uint16_t milliseconds)
+{
+    // catch an illegal argument
+    if (milliseconds == 0) {
+        milliseconds = 1;
+    }
+    m_step_interval = milliseconds;
+}
+
 ArduCor::Color
 ArduCor::mainColor()
 {
@@ -199,376 +403,972 @@ ArduCor::color(uint16_t i)
 }
 
 uint8_t
-ArduCor::red(uint16_t i)
+ArduCor::red(LEDIndex i)
 {
     if ((i < m_LED_count) && m_is_on) {
-        return r_buffer[i];
+        return r_buffer[ledOffset(i)];
     } else {
         return 0;
     }
 }
 
 uint8_t
-ArduCor::green(uint16_t i)
+ArduCor::green(LEDIndex i)
 {
     if ((i < m_LED_count) && m_is_on) {
-        return g_buffer[i];
+        return g_buffer[ledOffset(i)];
     } else {
         return 0;
     }
 }
 
 uint8_t
-ArduCor::blue(uint16_t i)
+ArduCor::blue(LEDIndex i)
 {
     if ((i < m_LED_count) && m_is_on) {
-        return b_buffer[i];
+        return b_buffer[ledOffset(i)];
     } else {
         return 0;
     }
 }
 
 
-
-//================================================================================
-// Pre Processing
-//================================================================================
-
-void
-ArduCor::preProcess(ERoutine routine, EPalette palette)
+ArduCor::LEDIndex
+ArduCor::copyFrame(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count)
 {
-    // prevent illegal values
-    if (palette >= ePalette_MAX) {
-        palette = (EPalette)((uint8_t)ePalette_MAX - 1);
-    }
-    if (palette < 0) {
-        palette = (EPalette)0;
+    // check the bounds once for the whole range
+    if (first >= m_strip_count) {
+        return 0;
     }
-
-    // detect if its a single color solid routine. This is a special case
-    // since it only needs to do its processing if its color is changed.
-    if (routine == (uint8_t)eSingleSolid) {
-        m_preprocess_flag = !setMainColor(m_temp_color.red,
-                                          m_temp_color.green,
-                                          m_temp_color.blue);
+    if (count > m_strip_count - first) {
+        count = m_strip_count - first;
     }
 
-    //---------
-    // Routine Has Changed
-    //---------
-    if ((m_current_routine != routine)
-        || m_preprocess_flag) {
-        // reset the temps
-        m_temp_index = 0;
-        m_temp_counter = 0;
-        m_temp_bool = true;
-        m_temp_color = {0,0,0};
-        m_preprocess_flag = true;
-        m_brightness_flag = true;
-        m_current_routine = routine;
+    if (m_layer_count == 0) {
+        copySegments(destination, order, first, count);
+        return count;
     }
-
-    //---------
-    // Group Has Changed
-    //---------
-    if ((m_current_palette != palette)
-        || m_preprocess_flag) {
-
-        // reset flag
-        m_preprocess_flag = false;
-        // reset the temps
-        m_temp_index = 0;
-        m_temp_counter = 0;
-        m_temp_bool = true;
-        m_temp_color = {0,0,0};
-
-        // reset fades, even when only the palette changes
-        if (routine == eMultiFade) {
-            m_temp_bool = true;
-            m_temp_counter = 0;
-            m_temp_float = m_fade_speed / 4.0f;
+    // the layers are blended a chunk at a time, so the chunk is still in the cache for each
+    // layer and the stack only needs room for one chunk of a layer.
+    uint8_t layerBuffer[LAYER_CHUNK_SIZE * 3];
+    LEDIndex chunk;
+    for (LEDIndex done = 0; done < count; done += chunk) {
+        chunk = count - done;
+        if (chunk > LAYER_CHUNK_SIZE) {
+            chunk = LAYER_CHUNK_SIZE;
         }
-
-        setupPalette(palette);
-        // setup the buffer to do a moving array.
-        if (routine == eMultiBars) {
-            m_temp_index = 0;
-            movingBufferSetup(m_temp_size, m_bar_size);
-        }
-        if (routine == eSingleWave) {
-            m_temp_index = 0;
-            m_temp_float = m_LED_count / (2 * m_bar_size);
-            movingBufferSetup(m_temp_float, m_bar_size, 1);
-        }
-        if (routine == eSingleSawtoothFade) {
-            m_temp_counter = m_fade_speed;
+        uint8_t *output = destination + (size_t)done * 3;
+        copySegments(output, order, first + done, chunk);
+        for (uint8_t i = 0; i < m_layer_count; ++i) {
+            const Layer& layer = m_layers[i];
+            if (layer.opacity == 0) {
+                continue;
+            }
+            LEDIndex copied = layer.routines->copyFrame(layerBuffer, order, first + done, chunk);
+            blendLayer(output, layerBuffer, (size_t)copied * 3, layer.mode, layer.opacity);
         }
-        m_current_palette = palette;
     }
+    return count;
 }
 
-
 void
-ArduCor::setupPalette(EPalette palette)
+ArduCor::copySegments(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count)
 {
-    // Set up the m_temp_array used for the multi color routines
-    // This is done by copying the relevant colors into the
-    // m_temp_array and storing the number of colors in m_temp_size.
-    if (palette == eCustom) {
-        m_temp_size = m_custom_count;
-        memcpy(m_temp_array, m_custom_colors, sizeof(m_custom_colors));
-    } else {
-        // For our PROGMEM we aimed to have as small of footprint as possible.
-        // We currently store a 2D array of color palettes, and another array of
-        // the sizes of those palettes groups. First we grab the size, then we copy
-        // the buffer directly from the 2D array.
-        m_temp_size = pgm_read_word_near(presetSizes + palette - 1);
-        memcpy_P(m_temp_array,
-                (void*)pgm_read_word_near(colorPresets + palette - 1),
-                (m_temp_size * 3));
+    // each segment is copied through its own view of the buffers. Only the view of a
+    // segment is loaded, so the selection and the palette of the selected segment stay.
+    storeSegment();
+    uint32_t end = (uint32_t)first + count;
+    for (uint8_t i = 0; i < segmentCount(); ++i) {
+        uint32_t segmentFirst = segmentOffset(i);
+        uint32_t segmentEnd = segmentFirst + segmentLength(i);
+        if ((segmentEnd <= first) || (segmentFirst >= end)) {
+            continue;
+        }
+        uint32_t start = (segmentFirst > first) ? segmentFirst : first;
+        uint32_t stop = (segmentEnd < end) ? segmentEnd : end;
+        loadView(i);
+        uint8_t *output = destination + (size_t)(start - first) * 3;
+        copyView(output, order, (LEDIndex)(start - segmentFirst), (LEDIndex)(stop - start));
+        if (m_transition_duration != 0) {
+            blendTransition(output,
+                            m_transition_buffer + (size_t)start * 3,
+                            (LEDIndex)(stop - start),
+                            order,
+                            transitionWeight());
+        }
     }
+    loadView(m_segment_index);
 }
 
-
-//================================================================================
-// Single Color Routines
-//================================================================================
-
-void
-ArduCor::turnOff()
+bool
+ArduCor::frameChanged()
 {
-    if (m_is_on) {
-      fillColorBuffers(0,0,0);
+    bool changed = m_frame_changed;
+    for (uint8_t i = 0; i < m_layer_count; ++i) {
+        changed = changed || m_layers[i].routines->frameChanged();
     }
-    m_is_on = false;
+    return changed;
 }
 
-void ArduCor::turnOn() {
-    if (!m_is_on) {
-      fillColorBuffers(m_temp_color.red, m_temp_color.green, m_temp_color.blue);
+ArduCor::LEDIndex
+ArduCor::changedFirst()
+{
+    // the first LED changed by this object or any layer
+    bool found = m_frame_changed;
+    LEDIndex first = m_dirty_first;
+    for (uint8_t i = 0; i < m_layer_count; ++i) {
+        ArduCor *layer = m_layers[i].routines;
+        if (layer->frameChanged() && (!found || (layer->changedFirst() < first))) {
+            first = layer->changedFirst();
+            found = true;
+        }
     }
-    m_is_on = true;
+    return first;
 }
 
+ArduCor::LEDIndex
+ArduCor::changedLast()
+{
+    // the last LED changed by this object or any layer, within the strip
+    bool found = m_frame_changed;
+    LEDIndex last = m_dirty_last;
+    for (uint8_t i = 0; i < m_layer_count; ++i) {
+        ArduCor *layer = m_layers[i].routines;
+        if (layer->frameChanged() && (!found || (layer->changedLast() > last))) {
+            last = layer->changedLast();
+            found = true;
+        }
+    }
+    if (last >= m_strip_count) {
+        last = m_strip_count - 1;
+    }
+    return last;
+}
 
 void
-ArduCor::singleSolid(uint8_t red, uint8_t green, uint8_t blue)
+ArduCor::clearFrameChanged()
 {
-    m_temp_color = {red, green, blue};
-    preProcess(eSingleSolid, m_current_palette);
-    if (m_temp_bool) {
-        fillColorBuffers(red, green, blue);
-        m_temp_bool = false;
+    m_frame_changed = false;
+    for (uint8_t i = 0; i < m_layer_count; ++i) {
+        m_layers[i].routines->clearFrameChanged();
     }
-    m_brightness_flag = false;
 }
 
-
-void
-ArduCor::singleBlink(uint8_t red, uint8_t green, uint8_t blue)
+bool
+ArduCor::startTransition(uint16_t duration)
 {
-    preProcess(eSingleBlink, m_current_palette);
-    // switches states between on/off based off of m_blink_speed
-    if (!(m_temp_counter % m_blink_speed)) {
-        if (m_temp_bool) {
-            fillColorBuffers(red, green, blue);
-        } else {
-            fillColorBuffers(0,0,0);
+    if (duration == 0) {
+        return false;
+    }
+    if (!m_transition_buffer) {
+        m_transition_buffer = (uint8_t*)malloc(frameBufferSize());
+        if (!m_transition_buffer) {
+            return false;
         }
-        m_temp_bool = !m_temp_bool;
     }
-    m_brightness_flag = false;
-    m_temp_counter++;
+    // keep the segment's frame as it is shown now
+    uint8_t *previous = m_transition_buffer + (size_t)m_segment_first * 3;
+    if (m_transition_duration == 0) {
+        copyView(previous, eOrderRGB, 0, m_LED_count);
+        ++m_transition_count;
+    } else {
+        // the shown frame is a mix of the two, which is built in place a chunk at a time
+        uint8_t chunkBuffer[LAYER_CHUNK_SIZE * 3];
+        uint16_t weight = transitionWeight();
+        LEDIndex chunk;
+        for (LEDIndex done = 0; done < m_LED_count; done += chunk) {
+            chunk = m_LED_count - done;
+            if (chunk > LAYER_CHUNK_SIZE) {
+                chunk = LAYER_CHUNK_SIZE;
+            }
+            copyView(chunkBuffer, eOrderRGB, done, chunk);
+            blendTransition(chunkBuffer, previous + (size_t)done * 3, chunk, eOrderRGB, weight);
+            memcpy(previous + (size_t)done * 3, chunkBuffer, (size_t)chunk * 3);
+        }
+    }
+    m_transition_duration = duration;
+    m_transition_time = 0;
+    return true;
 }
 
-
-void
-ArduCor::singleWave(uint8_t red, uint8_t green, uint8_t blue)
+bool
+ArduCor::advanceTransition(uint32_t elapsed)
 {
-    preProcess(eSingleWave, m_current_palette);
-    m_repeat_index = 0;
-    // loop through all the values between 0 and m_loop_index m_loop_count times.
-    for (x = 0; x < (m_loop_count * m_loop_index); ++x) {
-        // if we are computing values above m_LED_count, ignore.
-        if (x < m_LED_count) {
-            // m_temp_counter holds the index in this instance of a repeat through
-            // the looped values.
-            m_temp_counter = (m_repeat_index + m_temp_index) % m_loop_index;
-            r_buffer[x] = (uint8_t)(red * (m_temp_buffer[m_temp_counter] / m_temp_float));
-            g_buffer[x] = (uint8_t)(green * (m_temp_buffer[m_temp_counter] / m_temp_float));
-            b_buffer[x] = (uint8_t)(blue * (m_temp_buffer[m_temp_counter] / m_temp_float));
-            // if a loop is pushing a repeat_index over m_loop_index, go back to 0
-            m_repeat_index = (x + 1) % m_loop_index;
+    if (m_transition_duration == 0) {
+        return false;
+    }
+    uint32_t time = (uint32_t)m_transition_time + elapsed;
+    if (time < m_transition_duration) {
+        m_transition_time = (uint16_t)time;
+    } else {
+        // the new routine is shown on its own, so the old frame is let go once no other
+        // segment needs it
+        m_transition_duration = 0;
+        m_transition_time = 0;
+        if (--m_transition_count == 0) {
+            free(m_transition_buffer);
+            m_transition_buffer = 0;
         }
     }
-    m_brightness_flag = false;
-    m_temp_index = (m_temp_index + 1) % m_loop_index;
+    markShown(0, m_LED_count - 1);
+    return true;
 }
 
+uint16_t
+ArduCor::transitionWeight()
+{
+    return 256 - (uint16_t)(((uint32_t)m_transition_time << 8) / m_transition_duration);
+}
 
 void
-ArduCor::singleGlimmer(uint8_t red, uint8_t green, uint8_t blue, uint8_t percent)
+ArduCor::setLayers(const Layer *layers, uint8_t count)
 {
-    preProcess(eSingleGlimmer, m_current_palette);
-    // set all LEDs to the base color before applying glimmer
-    // to a subsection of them.
-    fillColorBuffers(red, green, blue);
-    for (x = 0; x < m_LED_count; ++x) {
-        // a random number is generated. If its less than the percent,
-        // treat this as an LED that gets a glimmer effect
-        if (random(1,101) < percent && percent != 0) {
-            // set a random level for the LED to be dimmed by.
-            m_scale_factor = (uint8_t)random(2,7);
-            r_buffer[x] = red / m_scale_factor;
-            g_buffer[x] = green / m_scale_factor;
-            b_buffer[x] = blue / m_scale_factor;
-        }
+    if (!layers) {
+        count = 0;
     }
-    m_brightness_flag = false;
+    m_layers = layers;
+    m_layer_count = count;
+    // the whole frame is sent again with the layers blended in
+    m_frame_changed = true;
+    m_dirty_first = 0;
+    m_dirty_last = m_strip_count - 1;
 }
 
-
 void
-ArduCor::singleFade(uint8_t red, uint8_t green, uint8_t blue, bool isSine)
+ArduCor::seedRandom(uint32_t seed)
 {
-    if (isSine) {
-        preProcess(eSingleFade, m_current_palette);
-        // calculate the next value using a sine function
-        m_temp_float = (sin(((m_temp_counter / (float)m_fade_speed) * 6.28f) - 1.67f) + 1) / 2.0f;
-        m_temp_step = 1;
-    } else {
-        preProcess(eSingleFade, m_current_palette);
-        // calculate how far throuhg the routine you are
-        m_temp_float = m_temp_counter / (float)m_fade_speed;
-        m_temp_step = 2;
+    // xorshift gets stuck at 0, so replace it with the default seed
+    if (seed == 0) {
+        seed = DEFAULT_RANDOM_SEED;
     }
-    // increment/decrement the counter
-    if (m_temp_bool)  m_temp_counter = m_temp_counter + m_temp_step;
-    else              m_temp_counter = m_temp_counter - m_temp_step;
-
-    // constrain the fade
-    if (m_temp_counter >= m_fade_speed) m_temp_bool = false;
-    else if (m_temp_counter == 0)       m_temp_bool = true;
-
-    // draws the current state of the fade to the buffers
-    fillColorBuffers(red * m_temp_float,
-                     green * m_temp_float,
-                     blue * m_temp_float);
-    
-    m_brightness_flag = false;
+    m_random_state = seed;
 }
 
 void
-ArduCor::singleSawtoothFade(uint8_t red, uint8_t green, uint8_t blue, bool fadeIn)
+ArduCor::randomBytes(uint8_t *buffer, uint16_t count)
 {
-    // set up values based on whether its a fade in or a fade out.
-    if (fadeIn) {
-        preProcess(eSingleSawtoothFade, m_current_palette);
-        m_temp_goal = m_fade_speed;
-        m_temp_index = 0;
-        m_temp_step = 1;
-    } else {
-        preProcess(eSingleSawtoothFade, m_current_palette);
-        m_temp_goal = 0;
-        m_temp_index = m_fade_speed;
-        m_temp_step = -1;
-    }
-    // apply the fade
-    if (m_temp_bool) {
-        m_temp_counter = m_temp_counter + m_temp_step;
-    } else {
-        m_temp_counter = m_temp_index;
-        m_temp_bool = true;
+    // use all four bytes of each step of the generator
+    uint16_t i = 0;
+    while (i < count) {
+        uint32_t value = nextRandom();
+        for (uint8_t byteIndex = 0; (byteIndex < 4) && (i < count); ++byteIndex) {
+            buffer[i++] = (uint8_t)value;
+            value >>= 8;
+        }
     }
-
-    // constrain the fade
-    if (m_temp_counter == m_temp_goal) m_temp_bool = false;
-    // draws the current state of the fade to the buffers
-    fillColorBuffers((red * (m_temp_counter / (float)m_fade_speed)),
-                     (green * (m_temp_counter / (float)m_fade_speed)),
-                     (blue * (m_temp_counter / (float)m_fade_speed)));
-    m_brightness_flag = false;
 }
 
+uint16_t
+ArduCor::randomIndex(uint16_t count)
+{
+    // scale the top 16 bits into the range instead of dividing. The bias this leaves
+    // is at most count / 65536, far below what is visible.
+    return (uint16_t)(((nextRandom() >> 16) * count) >> 16);
+}
 
 //================================================================================
-// Multi Color Routines
+// Segments
 //================================================================================
 
-void
-ArduCor::multiGlimmer(EPalette palette, uint8_t percent)
+bool
+ArduCor::setupSegments(uint8_t count, const LEDIndex *lengths)
 {
-    preProcess(eMultiGlimmer, palette);
-    // set all LEDs to the base color before applying glimmer
-    // to a subsection of them.
-    fillColorBuffers(m_temp_array[0].red,
-                     m_temp_array[0].green,
-                     m_temp_array[0].blue);
-    for (x = 0; x < m_LED_count; ++x) {
-        if (random(1,101) < percent && percent != 0) {
-            // m_temp_color is set in chooseRandomFromArray
-            chooseRandomFromArray(m_temp_array, m_temp_size, true);
-        } else {
-            m_temp_color = m_temp_array[0];
-        }
+    if (count == 0) {
+        return false;
+    }
+    Segment *segments = (Segment*)malloc(count * sizeof(Segment));
+    if (!segments) {
+        return false;
+    }
+    // lay the segments out along the strip, each one's part of the temp buffer must
+    // be able to hold a pattern with one LED for each palette color.
+    const uint16_t minTempSize = sizeof(m_temp_array) / sizeof(Color);
+    uint32_t first = 0;
+    uint32_t tempSize = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        LEDIndex length = m_strip_count / count;
+        if (lengths) {
+            length = lengths[i];
+        } else if (i == count - 1) {
+            length = m_strip_count - (LEDIndex)first;
+        }
+        segments[i].first = (LEDIndex)first;
+        segments[i].count = length;
+        segments[i].tempFirst = (LEDIndex)tempSize;
+        first += length;
+        tempSize += (length < minTempSize) ? minTempSize : length;
+        if ((length == 0) || (first > m_strip_count)) {
+            free(segments);
+            return false;
+        }
+    }
+    if ((first != m_strip_count) || (tempSize > (LEDIndex)~0)) {
+        free(segments);
+        return false;
+    }
+    // the temp buffer is only replaced if the segments' parts don't fit in it
+    uint8_t *tempStorage = m_temp_storage;
+    if ((tempSize > m_temp_storage_size)
+        && !(tempStorage = (uint8_t*)malloc(tempSize))) {
+        free(segments);
+        return false;
+    }
+    memset(tempStorage, 0, tempSize);
+    free(m_segments);
+    m_segments = segments;
+    m_segment_count = count;
+    if (tempStorage != m_temp_storage) {
+        if (m_owns_temp_storage) {
+            free(m_temp_storage);
+        }
+        m_temp_storage = tempStorage;
+        m_temp_storage_size = (LEDIndex)tempSize;
+        m_owns_temp_storage = true;
+    }
+
+    // the segments start without a transition
+    free(m_transition_buffer);
+    m_transition_buffer = 0;
+    m_transition_count = 0;
+    m_transition_duration = 0;
+    m_transition_time = 0;
+
+    // give each segment the default routine
+    for (uint8_t i = 0; i < count; ++i) {
+        m_segment_index = i;
+        setupWindow(m_segments[i].first, m_segments[i].count);
+        m_temp_buffer = m_temp_storage + m_segments[i].tempFirst;
+        m_fill_valid = false;
+        m_rotation_length = 0;
+        m_rotation_offset = 0;
+        m_pattern_valid = false;
+        m_pattern_dimmed = false;
+        m_frame_dimmed = false;
+        resetSegment();
+        storeSegment();
+    }
+    loadSegment(0);
+    return true;
+}
+
+bool
+ArduCor::selectSegment(uint8_t index)
+{
+    if (index >= segmentCount()) {
+        return false;
+    }
+    if (index != m_segment_index) {
+        storeSegment();
+        loadSegment(index);
+    }
+    return true;
+}
+
+ArduCor::LEDIndex
+ArduCor::segmentOffset(uint8_t index)
+{
+    if (index < m_segment_count) {
+        return m_segments[index].first;
+    }
+    return 0;
+}
+
+ArduCor::LEDIndex
+ArduCor::segmentLength(uint8_t index)
+{
+    if (index < m_segment_count) {
+        return m_segments[index].count;
+    } else if (index == 0) {
+        return m_strip_count;
+    }
+    return 0;
+}
+
+//================================================================================
+// Routines
+//================================================================================
+
+// each routine's setup and frame functions, in the order of ERoutine. Stored in program
+// memory, since a table of member function pointers would take most of 100 bytes of RAM.
+const PROGMEM ArduCor::RoutineEntry ArduCor::s_routine_table[eRoutine_MAX] = {
+    { 0,                                 &ArduCor::drawSingleSolid },
+    { 0,                                 &ArduCor::drawSingleBlink },
+    { &ArduCor::setupSingleWave,         &ArduCor::drawSingleWave },
+    { &ArduCor::setupGlimmerState,       &ArduCor::drawSingleGlimmer },
+    { 0,                                 &ArduCor::drawSingleFade },
+    { &ArduCor::setupSingleSawtoothFade, &ArduCor::drawSingleSawtoothFade },
+    { &ArduCor::setupGlimmerState,       &ArduCor::drawMultiGlimmer },
+    { &ArduCor::setupMultiFade,          &ArduCor::drawMultiFade },
+    { 0,                                 &ArduCor::drawMultiRandomSolid },
+    { 0,                                 &ArduCor::drawMultiRandomIndividual },
+    { &ArduCor::setupMultiBars,          &ArduCor::drawMultiBars },
+};
+
+void
+ArduCor::runRoutine(uint8_t routine, EPalette palette, uint16_t parameter)
+{
+    m_steps = 1;
+    advanceTransition(m_step_interval);
+    drawRoutine(routine, palette, parameter);
+}
+
+bool
+ArduCor::runRoutine(uint8_t routine, EPalette palette, uint16_t parameter, uint32_t elapsed)
+{
+    // add up the steps that are due, and keep the rest of the time for the next call
+    uint32_t time = m_step_time + elapsed;
+    uint32_t steps = time / m_step_interval;
+    m_step_time = time - steps * m_step_interval;
+    if (steps > 0xFFFF) {
+        steps = 0xFFFF;
+    }
+    m_steps = steps;
+    advanceTransition(elapsed);
+    return drawRoutine(routine, palette, parameter);
+}
+
+bool
+ArduCor::drawRoutine(uint8_t routine, EPalette palette, uint16_t parameter)
+{
+    // prevent illegal values
+    if (routine >= eRoutine_MAX + m_custom_routine_count) {
+        return false;
+    }
+    if (palette >= ePalette_MAX) {
+        palette = (EPalette)((uint8_t)ePalette_MAX - 1);
+    }
+    if (palette < 0) {
+        palette = (EPalette)0;
+    }
+    // single color routines draw with the main color, so they keep the current palette
+    if (!isMultiColor(routine)) {
+        palette = m_current_palette;
+    }
+    if (routine >= eRoutine_MAX) {
+        return runCustomRoutine(m_custom_routines[routine - eRoutine_MAX], routine, palette, parameter);
+    }
+    // the bars are part of the pattern, so a new size sets the routine up again
+    if (routine == eMultiBars) {
+        barSize(parameter);
+    }
+
+    RoutineEntry entry;
+    memcpy_P(&entry, &s_routine_table[routine], sizeof(RoutineEntry));
+    if ((routine != m_current_routine)
+        || (palette != m_current_palette)
+        || m_preprocess_flag) {
+        startRoutine(routine, palette, entry.setup);
+    }
+    if (m_steps == 0) {
+        return false;
+    }
+    (this->*entry.draw)(parameter);
+    return true;
+}
+
+bool
+ArduCor::runCustomRoutine(const CustomRoutine& custom, uint8_t routine, EPalette palette, uint16_t parameter)
+{
+    if ((routine != m_current_routine)
+        || (palette != m_current_palette)
+        || m_preprocess_flag) {
+        startRoutine(routine, palette, 0);
+        memset(&m_state, 0, sizeof(m_state));
+        if (custom.setup) {
+            custom.setup(*this);
+        }
+    }
+    if (m_steps == 0) {
+        return false;
+    }
+    custom.draw(*this, parameter);
+    // like the built in single color routines, these stay at full brightness
+    if (!custom.usesPalette) {
+        m_brightness_flag = false;
+    }
+    return true;
+}
+
+//================================================================================
+// Custom Routines
+//================================================================================
+
+void
+ArduCor::setCustomRoutines(const CustomRoutine *customRoutines, uint8_t count)
+{
+    // the routine values have to fit in a byte
+    if (count > 255 - eRoutine_MAX) {
+        count = 255 - eRoutine_MAX;
+    }
+    if (!customRoutines) {
+        count = 0;
+    }
+    m_custom_routines = customRoutines;
+    m_custom_routine_count = count;
+}
+
+bool
+ArduCor::isMultiColor(uint8_t routine)
+{
+    if (routine < eRoutine_MAX) {
+        return (routine > eSingleSawtoothFade);
+    }
+    if (routine < eRoutine_MAX + m_custom_routine_count) {
+        return m_custom_routines[routine - eRoutine_MAX].usesPalette;
+    }
+    return false;
+}
+
+//================================================================================
+// Pre Processing
+//================================================================================
+
+void
+ArduCor::startRoutine(uint8_t routine, EPalette palette, RoutineFunction setup)
+{
+    m_preprocess_flag = false;
+    m_current_routine = routine;
+    m_current_palette = palette;
+    m_brightness_flag = true;
+    // reset the temps
+    m_temp_index = 0;
+    m_temp_counter = 0;
+    m_temp_bool = true;
+    m_temp_color = {0,0,0};
+    // the next frame is drawn from scratch
+    m_rotation_length = 0;
+    m_pattern_valid = false;
+    // the routine starts on this frame, so it doesn't take the steps due for the last one
+    m_steps = 1;
+    m_step_time = 0;
+
+    setupPalette(palette);
+    if (setup) {
+        (this->*setup)();
+    }
+}
+
+void
+ArduCor::setupPalette(EPalette palette)
+{
+    // Set up the m_temp_array used for the multi color routines
+    // This is done by copying the relevant colors into the
+    // m_temp_array and storing the number of colors in m_temp_size.
+    // The copy is kept while it is current, so switching routines or
+    // segments with the same palette doesn't read it again.
+    if (isPaletteCurrent(m_temp_palette, m_temp_generation, palette)) {
+        return;
+    }
+    m_temp_size = copyPalette(palette, m_temp_array);
+    m_temp_palette = palette;
+    m_temp_generation = m_custom_generation;
+}
+
+uint8_t
+ArduCor::copyPalette(EPalette palette, Color *colors)
+{
+    if (palette == eCustom) {
+        memcpy(colors, m_custom_colors, sizeof(m_custom_colors));
+        // the count can be set higher than the custom colors that exist
+        if (m_custom_count > (sizeof(m_custom_colors) / sizeof(Color))) {
+            return sizeof(m_custom_colors) / sizeof(Color);
+        }
+        return m_custom_count;
+    }
+    // For our PROGMEM we aimed to have as small of footprint as possible.
+    // We currently store a 2D array of color palettes, and another array of
+    // the sizes of those palettes groups. First we grab the size, then we copy
+    // the buffer directly from the 2D array.
+    uint8_t size = pgm_read_word_near(presetSizes + palette - 1);
+    memcpy_P(colors,
+            (void*)pgm_read_word_near(colorPresets + palette - 1),
+            (size * 3));
+    return size;
+}
+
+const ArduCor::Color*
+ArduCor::paletteGradient()
+{
+    if (m_gradient && isPaletteCurrent(m_gradient_palette, m_gradient_generation, m_current_palette)) {
+        return m_gradient;
+    }
+    if (!m_gradient) {
+        m_gradient = (Color*)malloc(GRADIENT_SIZE * sizeof(Color));
+        if (!m_gradient) {
+            return 0;
+        }
+    }
+    Color colors[sizeof(m_custom_colors) / sizeof(Color)];
+    uint8_t count = copyPalette(m_current_palette, colors);
+    if (count == 0) {
+        memset(m_gradient, 0, GRADIENT_SIZE * sizeof(Color));
+    } else {
+        // each color gets an equal part of the table, blending into the next color. The
+        // last color blends back into the first, so the table can be scrolled through.
+        for (uint16_t phase = 0; phase < GRADIENT_SIZE; ++phase) {
+            uint16_t position = phase * count;
+            uint8_t index = position / GRADIENT_SIZE;
+            uint32_t blend = (uint32_t)(position % GRADIENT_SIZE) << 8;
+            const Color& from = colors[index];
+            const Color& to = colors[(index + 1 < count) ? index + 1 : 0];
+            m_gradient[phase] = { blendChannel(from.red, to.red, blend),
+                                  blendChannel(from.green, to.green, blend),
+                                  blendChannel(from.blue, to.blue, blend) };
+        }
+    }
+    m_gradient_palette = m_current_palette;
+    m_gradient_generation = m_custom_generation;
+    return m_gradient;
+}
+
+void
+ArduCor::setupSingleWave()
+{
+    // a wave with more levels than fit in a byte would wrap around, so a long
+    // strip widens the steps of the wave instead.
+    LEDIndex levels = m_LED_count / (2 * m_bar_size);
+    uint16_t stepSize = m_bar_size;
+    if (levels > MAX_WAVE_LEVELS) {
+        stepSize = m_bar_size * ((levels + MAX_WAVE_LEVELS - 1) / MAX_WAVE_LEVELS);
+        levels = m_LED_count / (2 * (LEDIndex)stepSize);
+    }
+    // catch an edge case with tiny arrays, a wave needs at least two levels
+    if (levels < 2) {
+        levels = 2;
+    }
+    movingBufferSetup(levels, stepSize, 1);
+    // store each level as a fraction of 256, so drawing the wave only takes
+    // a multiply and a shift per channel.
+    for (x = 0; x < m_state.pattern.loopLength; ++x) {
+        m_temp_buffer[x] = ((uint16_t)m_temp_buffer[x] << 8) / (uint16_t)levels;
+    }
+}
+
+void
+ArduCor::setupSingleSawtoothFade()
+{
+    // the first frame starts the fade, dark for a fade in and full for a fade out
+    m_temp_bool = false;
+}
+
+void
+ArduCor::setupGlimmerState()
+{
+    // the thresholds are built on the first frame
+    m_state.glimmer.percent = 0;
+}
+
+void
+ArduCor::setupMultiFade()
+{
+    m_state.fade.goal = {0, 0, 0};
+    m_state.fade.counter = 0;
+}
+
+void
+ArduCor::setupMultiBars()
+{
+    // setup the buffer to do a moving array.
+    movingBufferSetup(m_temp_size, m_bar_size);
+}
+
+//================================================================================
+// Single Color Routines
+//================================================================================
+
+void
+ArduCor::turnOff()
+{
+    if (m_is_on) {
+      fillColorBuffers(0,0,0);
+      // the getters change even if the buffers don't
+      markDirty(0, m_LED_count - 1);
+    }
+    m_is_on = false;
+}
+
+void ArduCor::turnOn() {
+    if (!m_is_on) {
+      m_is_on = true;
+      fillColorBuffers(m_temp_color.red, m_temp_color.green, m_temp_color.blue);
+      markDirty(0, m_LED_count - 1);
+    }
+    m_is_on = true;
+}
+
+
+void
+ArduCor::singleSolid(uint8_t red, uint8_t green, uint8_t blue)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleSolid, m_current_palette, 0);
+}
+
+void
+ArduCor::singleBlink(uint8_t red, uint8_t green, uint8_t blue)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleBlink, m_current_palette, 0);
+}
+
+void
+ArduCor::singleWave(uint8_t red, uint8_t green, uint8_t blue)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleWave, m_current_palette, 0);
+}
+
+void
+ArduCor::singleGlimmer(uint8_t red, uint8_t green, uint8_t blue, uint8_t percent)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleGlimmer, m_current_palette, percent);
+}
+
+void
+ArduCor::singleFade(uint8_t red, uint8_t green, uint8_t blue, bool isSine)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleFade, m_current_palette, isSine);
+}
+
+void
+ArduCor::singleSawtoothFade(uint8_t red, uint8_t green, uint8_t blue, bool fadeIn)
+{
+    setMainColor(red, green, blue);
+    runRoutine(eSingleSawtoothFade, m_current_palette, fadeIn);
+}
+
+
+void
+ArduCor::drawSingleSolid(uint16_t)
+{
+    // the fill is skipped while the frame already has the color
+    fillColorBuffers(m_main_color.red, m_main_color.green, m_main_color.blue);
+    m_brightness_flag = false;
+}
+
+
+void
+ArduCor::drawSingleBlink(uint16_t)
+{
+    // on for m_blink_speed steps, then off for as many. The fill is skipped while the
+    // frame already has the color.
+    uint16_t period = 2 * (uint16_t)m_blink_speed;
+    m_temp_counter = (m_temp_counter + skippedSteps()) % period;
+    if (m_temp_counter < m_blink_speed) {
+        fillColorBuffers(m_main_color.red, m_main_color.green, m_main_color.blue);
+    } else {
+        fillColorBuffers(0,0,0);
+    }
+    m_brightness_flag = false;
+    m_temp_counter++;
+}
+
+
+void
+ArduCor::drawSingleWave(uint16_t)
+{
+    // the wave is drawn again only when its color changes
+    if (startRotation()) {
+        drawPattern(0, m_LED_count);
+    }
+    advanceRotation();
+    m_brightness_flag = false;
+}
+
+
+void
+ArduCor::drawSingleGlimmer(uint16_t percent)
+{
+    // set all LEDs to the base color before applying glimmer
+    // to a subsection of them.
+    fillColorBuffers(m_main_color.red, m_main_color.green, m_main_color.blue);
+    setupGlimmer(percent);
+    // dim a random level on each LED that gets a glimmer effect
+    glimmerPass(false);
+    m_brightness_flag = false;
+}
+
+
+void
+ArduCor::drawSingleFade(uint16_t isSine)
+{
+    uint8_t step = isSine ? 1 : 2;
+    // the fade repeats after going up and back down, so at most one of those is skipped
+    uint16_t skipped = skippedSteps() % (2 * ((m_fade_speed + step - 1) / step));
+    for (; skipped > 0; --skipped) {
+        stepFade(step);
+    }
+    uint32_t scale;
+    if (isSine) {
+        // calculate the next value using a sine function
+        scale = sineScale(m_temp_counter, m_fade_speed);
+    } else {
+        // calculate how far throuhg the routine you are
+        scale = fadeScale(m_temp_counter, m_fade_speed);
+    }
+    stepFade(step);
+
+    // draws the current state of the fade to the buffers
+    fillColorBuffers(scaleChannel(m_main_color.red, scale),
+                     scaleChannel(m_main_color.green, scale),
+                     scaleChannel(m_main_color.blue, scale));
+
+    m_brightness_flag = false;
+}
+
+void
+ArduCor::stepFade(uint8_t step)
+{
+    // increment/decrement the counter
+    if (m_temp_bool)  m_temp_counter = m_temp_counter + step;
+    else              m_temp_counter = m_temp_counter - step;
+
+    // constrain the fade
+    if (m_temp_counter >= m_fade_speed) m_temp_bool = false;
+    else if (m_temp_counter == 0)       m_temp_bool = true;
+}
+
+void
+ArduCor::drawSingleSawtoothFade(uint16_t fadeIn)
+{
+    // set up values based on whether its a fade in or a fade out.
+    uint8_t goal = fadeIn ? m_fade_speed : 0;
+    uint8_t start = fadeIn ? 0 : m_fade_speed;
+    int step = fadeIn ? 1 : -1;
+    // the skipped steps are applied along with the one for this frame. The fade repeats
+    // every m_fade_speed + 1 steps.
+    uint16_t steps = skippedSteps() % ((uint16_t)m_fade_speed + 1) + 1;
+    for (; steps > 0; --steps) {
+        // apply the fade
+        if (m_temp_bool) {
+            m_temp_counter = m_temp_counter + step;
+        } else {
+            m_temp_counter = start;
+            m_temp_bool = true;
+        }
+
+        // constrain the fade
+        if (m_temp_counter == goal) m_temp_bool = false;
+    }
+    // draws the current state of the fade to the buffers
+    uint32_t scale = fadeScale(m_temp_counter, m_fade_speed);
+    fillColorBuffers(scaleChannel(m_main_color.red, scale),
+                     scaleChannel(m_main_color.green, scale),
+                     scaleChannel(m_main_color.blue, scale));
+    m_brightness_flag = false;
+}
+
+
+//================================================================================
+// Multi Color Routines
+//================================================================================
+
+void
+ArduCor::multiGlimmer(EPalette palette, uint8_t percent)
+{
+    runRoutine(eMultiGlimmer, palette, percent);
+}
+
+void
+ArduCor::multiFade(EPalette palette)
+{
+    runRoutine(eMultiFade, palette, 0);
+}
+
+void
+ArduCor::multiRandomSolid(EPalette palette)
+{
+    runRoutine(eMultiRandomSolid, palette, 0);
+}
 
-        // a random number is generated, if its less than the percent,
-        // treat this as an LED that gets a glimmer effect
-        if (random(1,101) < percent && percent != 0) {
-            // chooses how much to divide the input by
-            m_scale_factor = (uint8_t)random(2,7);
-            r_buffer[x] = m_temp_color.red / m_scale_factor;
-            g_buffer[x] = m_temp_color.green / m_scale_factor;
-            b_buffer[x] = m_temp_color.blue / m_scale_factor;
-        } else {
-            r_buffer[x] = m_temp_color.red;
-            g_buffer[x] = m_temp_color.green;
-            b_buffer[x] = m_temp_color.blue;
-        }
+void
+ArduCor::multiRandomIndividual(EPalette palette)
+{
+    runRoutine(eMultiRandomIndividual, palette, 0);
+}
+
+void
+ArduCor::multiBars(EPalette palette, uint16_t barSizeSetting)
+{
+    runRoutine(eMultiBars, palette, barSizeSetting);
+}
+
+
+void
+ArduCor::drawMultiGlimmer(uint16_t percent)
+{
+    // set all LEDs to the base color before applying glimmer
+    // to a subsection of them.
+    fillColorBuffers(m_temp_array[0].red,
+                     m_temp_array[0].green,
+                     m_temp_array[0].blue);
+    setupGlimmer(percent);
+    // the color change and the dimming are chosen independently for each LED, so they
+    // are done as two passes. The dimming pass divides whatever color the LED ended up with.
+    glimmerPass(true);
+    glimmerPass(false);
+}
+
+
+void
+ArduCor::drawMultiFade(uint16_t)
+{
+    // each fade between two colors takes a quarter of the fade speed in steps
+    uint8_t fadeSteps = m_fade_speed / 4;
+    if (fadeSteps == 0) {
+        fadeSteps = 1;
+    }
+    // the skipped steps are run without drawing. The fade repeats once it has been
+    // through every color of the palette.
+    uint16_t skipped = skippedSteps() % (((uint16_t)fadeSteps + 1) * (m_temp_size ? m_temp_size : 1));
+    for (; skipped > 0; --skipped) {
+        nextFadeColors();
+        if (m_state.fade.counter == fadeSteps) m_temp_bool = true;
+        m_state.fade.counter++;
     }
+
+    nextFadeColors();
+    // draws to buffer
+    const Color& goal = m_state.fade.goal;
+    uint32_t scale = fadeScale(m_state.fade.counter, fadeSteps);
+    fillColorBuffers(blendChannel(m_temp_color.red, goal.red, scale),
+                     blendChannel(m_temp_color.green, goal.green, scale),
+                     blendChannel(m_temp_color.blue, goal.blue, scale));
+
+    if (m_state.fade.counter == fadeSteps) m_temp_bool = true;
+    m_state.fade.counter++;
 }
 
 
 void
-ArduCor::multiFade(EPalette palette)
+ArduCor::nextFadeColors()
 {
-    preProcess(eMultiFade, palette);
     // checks if it should change the colors it is fading between.
     if (m_temp_bool) {
         m_temp_bool = false;
         if (m_temp_size > 1) {
-            m_fade_counter = 0;
+            m_state.fade.counter = 0;
             m_temp_counter = (m_temp_counter + 1) % m_temp_size;
             m_temp_color = m_temp_array[m_temp_counter];
-            m_goal_color = m_temp_array[(m_temp_counter + 1) % m_temp_size];
-            m_red_diff   = m_temp_color.red - m_goal_color.red;
-            m_green_diff = m_temp_color.green - m_goal_color.green;
-            m_blue_diff  = m_temp_color.blue - m_goal_color.blue;
+            m_state.fade.goal = m_temp_array[(m_temp_counter + 1) % m_temp_size];
         } else {
             m_temp_counter = 0;
-            m_goal_color = m_temp_array[0];
+            m_state.fade.goal = m_temp_array[0];
             m_temp_color = m_temp_array[0];
-            m_red_diff = 0;
-            m_green_diff = 0;
-            m_blue_diff = 0;
         }
     }
-
-   // draws to buffer
-   fillColorBuffers(m_temp_color.red - (m_red_diff * (m_fade_counter / m_temp_float)),
-                    m_temp_color.green - (m_green_diff * (m_fade_counter / m_temp_float)),
-                    m_temp_color.blue - (m_blue_diff * (m_fade_counter / m_temp_float)));
-
-    if (m_fade_counter == m_temp_float) m_temp_bool = true;
-    m_fade_counter++;
 }
 
-
 void
-ArduCor::multiRandomSolid(EPalette palette)
+ArduCor::drawMultiRandomSolid(uint16_t)
 {
-    preProcess(eMultiRandomSolid, palette);
-    if (!(m_temp_counter % m_blink_speed)) {
+    // a new color is chosen every m_blink_speed steps, including when one of the
+    // skipped steps was due for one.
+    uint16_t phase = m_temp_counter % m_blink_speed;
+    m_temp_counter += skippedSteps();
+    if ((phase == 0) || ((uint32_t)phase + skippedSteps() >= m_blink_speed)) {
         chooseRandomFromArray(m_temp_array, m_temp_size, true);
         fillColorBuffers(m_temp_color.red, m_temp_color.green, m_temp_color.blue);
         // always apply the brightness after an update
@@ -578,40 +1378,24 @@ ArduCor::multiRandomSolid(EPalette palette)
 }
 
 void
-ArduCor::multiRandomIndividual(EPalette palette)
+ArduCor::drawMultiRandomIndividual(uint16_t)
 {
-    preProcess(eMultiRandomIndividual, palette);
     for (x = 0; x < m_LED_count; ++x) {
         // chooses a random color from m_temp_array
         chooseRandomFromArray(m_temp_array, m_temp_size, true);
         // draws the random color to the buffer.
-        r_buffer[x] = m_temp_color.red;
-        g_buffer[x] = m_temp_color.green;
-        b_buffer[x] = m_temp_color.blue;
+        setPixel(x, m_temp_color.red, m_temp_color.green, m_temp_color.blue);
     }
+    markDirty(0, m_LED_count - 1);
 }
 
 void
-ArduCor::multiBars(EPalette palette, uint8_t barSizeSetting)
+ArduCor::drawMultiBars(uint16_t)
 {
-    barSize(barSizeSetting);
-    preProcess(eMultiBars, palette);
-    m_repeat_index = 0;
-    // loop through all the values between 0 and m_loop_index m_loop_count times.
-    for (x = 0; x < (m_loop_count * m_loop_index); ++x) {
-        // if we are computing values above m_LED_count, ignore.
-        if (x < m_LED_count) {
-            // m_temp_counter holds the index in this instance of a repeat through
-            // the looped values.
-            m_temp_counter = (m_repeat_index + m_temp_index) % m_loop_index;
-            r_buffer[x] = m_temp_array[m_temp_buffer[m_temp_counter]].red;
-            g_buffer[x] = m_temp_array[m_temp_buffer[m_temp_counter]].green;
-            b_buffer[x] = m_temp_array[m_temp_buffer[m_temp_counter]].blue;
-            // if a loop is pushing a repeat_index over m_loop_index, go back to 0
-            m_repeat_index = (x + 1) % m_loop_index;
-        }
+    if (startRotation()) {
+        drawPattern(0, m_LED_count);
     }
-    m_temp_index = (m_temp_index + 1) % m_loop_index;
+    advanceRotation();
 }
 
 //================================================================================
@@ -629,48 +1413,494 @@ ArduCor::applyBrightness()
             || (m_current_routine == eMultiRandomSolid)) {
             m_brightness_flag = false;
         }
-        // loop again to apply global effects
-        for(x = 0; x < m_LED_count; ++x) {
-            // Since this is expensive and often run on every LED update, we avoid
-            // floating point calculations for a bit of a speed increase.
-            r_buffer[x] = (uint8_t)((r_buffer[x] * (uint16_t)m_bright_level) / 100);
-            g_buffer[x] = (uint8_t)((g_buffer[x] * (uint16_t)m_bright_level) / 100);
-            b_buffer[x] = (uint8_t)((b_buffer[x] * (uint16_t)m_bright_level) / 100);
+        m_frame_dimmed = true;
+        if (m_rotation_length && !isMultiColor(m_current_routine)) {
+            // single color routines keep their pattern at full brightness, so a pattern
+            // dimmed here is only shown on this frame and drawn again on the next one.
+            m_pattern_valid = false;
+        } else if (m_rotation_length) {
+            // a rotating frame only needs its pattern dimmed once. If the settings have
+            // changed since then, the pattern is drawn again before it is dimmed.
+            if (m_pattern_dimmed && m_pattern_valid) {
+                return;
+            }
+            if (m_pattern_dimmed) {
+                m_temp_counter = 0;
+                markDirty(0, m_LED_count - 1);
+                drawFrame(true);
+                m_pattern_valid = true;
+                return;
+            }
+            m_pattern_dimmed = true;
         }
+        dimBuffers();
+    } else if (m_fill_valid && m_fill_shown && !m_fill_dimmed) {
+        // the fill was written again without the brightness, which is shown as it is
+        m_fill_shown = false;
+        markShown(0, m_LED_count - 1);
     }
 }
 
-
 bool
-ArduCor::drawColor(uint16_t i, uint8_t red, uint8_t green, uint8_t blue)
+ArduCor::drawColor(LEDIndex i, uint8_t red, uint8_t green, uint8_t blue)
 {
     // checks if its valid draw
     if (i < m_LED_count) {
-        r_buffer[i] = red;
-        g_buffer[i] = green;
-        b_buffer[i] = blue;
+        // the LED is drawn on top of the current frame, so a rotating frame has to be
+        // put in place first.
+        resolveRotation();
+        m_pattern_valid = false;
+        setPixel(i, red, green, blue);
+        markDirty(i, i);
         return true;
     }
     return false;
 }
 
+ArduCor::LEDIndex
+ArduCor::drawColors(LEDIndex first, LEDIndex count, const uint8_t *colors, uint8_t step)
+{
+    if (first >= m_LED_count) {
+        return 0;
+    }
+    if (count > m_LED_count - first) {
+        count = m_LED_count - first;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    resolveRotation();
+    m_pattern_valid = false;
+    for (LEDIndex i = 0; i < count; ++i) {
+        setPixel(first + i, colors[0], colors[1], colors[2]);
+        colors += step;
+    }
+    markDirty(first, first + count - 1);
+    return count;
+}
+
 //================================================================================
 // Helper Functions
 //================================================================================
 
 void
-ArduCor::movingBufferSetup(uint16_t colorCount, uint8_t groupSize, uint8_t startingValue)
+ArduCor::setupBuffers(LEDIndex ledCount, bool interleaved, EColorOrder order, uint8_t *frameStorage, uint8_t *tempStorage)
+{
+    m_strip_count = ledCount;
+    // catch an illegal argument
+    if (m_strip_count == 0) {
+        m_strip_count = 1;
+    }
+    m_interleaved = interleaved;
+    m_color_order = order;
+    m_stride = m_interleaved ? 3 : 1;
+    m_frame_changed = false;
+    m_fill_valid = false;
+    m_rotation_length = 0;
+    m_rotation_offset = 0;
+    m_pattern_valid = false;
+    m_pattern_dimmed = false;
+    m_frame_dimmed = false;
+    m_preprocess_flag = false;
+    m_custom_routines = 0;
+    m_custom_routine_count = 0;
+    m_layers = 0;
+    m_layer_count = 0;
+    m_transition_buffer = 0;
+    m_transition_count = 0;
+    m_transition_duration = 0;
+    m_transition_time = 0;
+    m_gradient = 0;
+    m_gradient_palette = ePalette_MAX;
+    m_gradient_generation = 0;
+    m_temp_palette = ePalette_MAX;
+    m_temp_generation = 0;
+    m_custom_generation = 0;
+    m_steps = 1;
+    m_segments = 0;
+    m_segment_count = 0;
+    m_segment_index = 0;
+
+    // allocate the arrays not known at runtime, unless the storage is provided. All three
+    // channels share one array, so an interleaved frame can be handed to a driver as is.
+    m_owns_strip_buffer = !frameStorage;
+    m_strip_buffer = frameStorage;
+    if (m_strip_buffer || (m_strip_buffer = (uint8_t*)malloc(frameBufferSize()))) {
+        memset(m_strip_buffer, 0, frameBufferSize());
+    }
+
+    // the moving buffer holds one value per LED, but a pattern with one LED for each
+    // palette color can be longer than a tiny array.
+    m_temp_storage_size = m_strip_count;
+    if (m_temp_storage_size < (sizeof(m_temp_array) / sizeof(Color))) {
+        m_temp_storage_size = sizeof(m_temp_array) / sizeof(Color);
+    }
+    m_owns_temp_storage = !tempStorage;
+    m_temp_storage = tempStorage;
+    if (m_temp_storage || (m_temp_storage = (uint8_t*)malloc(m_temp_storage_size))) {
+        memset(m_temp_storage, 0, m_temp_storage_size);
+    }
+    m_temp_buffer = m_temp_storage;
+
+    // until the strip is split, the whole strip is the selected segment
+    setupWindow(0, m_strip_count);
+}
+
+void
+ArduCor::setupWindow(LEDIndex first, LEDIndex count)
+{
+    m_segment_first = first;
+    m_LED_count = count;
+    if (m_interleaved) {
+        // each LED takes three bytes in the order the driver expects.
+        uint8_t r, g, b;
+        channelOffsets(m_color_order, &r, &g, &b);
+        m_frame_buffer = m_strip_buffer + (size_t)first * 3;
+        r_buffer = m_frame_buffer + r;
+        g_buffer = m_frame_buffer + g;
+        b_buffer = m_frame_buffer + b;
+    } else {
+        // each channel is stored in its own plane.
+        r_buffer = m_strip_buffer + first;
+        g_buffer = m_strip_buffer + m_strip_count + first;
+        b_buffer = m_strip_buffer + 2 * (size_t)m_strip_count + first;
+        m_frame_buffer = r_buffer;
+    }
+}
+
+void
+ArduCor::storeSegment()
+{
+    if (m_segment_count == 0) {
+        return;
+    }
+    Segment& segment = m_segments[m_segment_index];
+    segment.routine        = m_current_routine;
+    segment.palette        = m_current_palette;
+    segment.mainColor      = m_main_color;
+    segment.fillColor      = m_fill_color;
+    segment.tempColor      = m_temp_color;
+    segment.barSize        = m_bar_size;
+    segment.rotationLength = m_rotation_length;
+    segment.rotationOffset = m_rotation_offset;
+    segment.tempCounter    = m_temp_counter;
+    segment.tempIndex      = m_temp_index;
+    segment.stepInterval   = m_step_interval;
+    segment.stepTime       = m_step_time;
+    segment.transitionDuration = m_transition_duration;
+    segment.transitionTime = m_transition_time;
+    segment.state          = m_state;
+    segment.isOn           = m_is_on;
+    segment.brightnessFlag = m_brightness_flag;
+    segment.preprocessFlag = m_preprocess_flag;
+    segment.fillValid      = m_fill_valid;
+    segment.fillDimmed     = m_fill_dimmed;
+    segment.fillShown      = m_fill_shown;
+    segment.patternValid   = m_pattern_valid;
+    segment.patternDimmed  = m_pattern_dimmed;
+    segment.frameDimmed    = m_frame_dimmed;
+    segment.tempBool       = m_temp_bool;
+}
+
+void
+ArduCor::loadSegment(uint8_t index)
+{
+    const Segment& segment = m_segments[index];
+    m_segment_index = index;
+    setupWindow(segment.first, segment.count);
+    m_temp_buffer = m_temp_storage + segment.tempFirst;
+    m_current_routine  = segment.routine;
+    m_current_palette  = segment.palette;
+    m_main_color       = segment.mainColor;
+    m_fill_color       = segment.fillColor;
+    m_temp_color       = segment.tempColor;
+    m_bar_size         = segment.barSize;
+    m_rotation_length  = segment.rotationLength;
+    m_rotation_offset  = segment.rotationOffset;
+    m_temp_counter     = segment.tempCounter;
+    m_temp_index       = segment.tempIndex;
+    m_step_interval    = segment.stepInterval;
+    m_step_time        = segment.stepTime;
+    m_transition_duration = segment.transitionDuration;
+    m_transition_time  = segment.transitionTime;
+    m_state            = segment.state;
+    m_is_on            = segment.isOn;
+    m_brightness_flag  = segment.brightnessFlag;
+    m_preprocess_flag  = segment.preprocessFlag;
+    m_fill_valid       = segment.fillValid;
+    m_fill_dimmed      = segment.fillDimmed;
+    m_fill_shown       = segment.fillShown;
+    m_pattern_valid    = segment.patternValid;
+    m_pattern_dimmed   = segment.patternDimmed;
+    m_frame_dimmed     = segment.frameDimmed;
+    m_temp_bool        = segment.tempBool;
+    // the palette colors are shared, so they are copied again instead of stored
+    setupPalette(m_current_palette);
+}
+
+void
+ArduCor::loadView(uint8_t index)
+{
+    if (m_segment_count == 0) {
+        return;
+    }
+    const Segment& segment = m_segments[index];
+    setupWindow(segment.first, segment.count);
+    m_rotation_length  = segment.rotationLength;
+    m_rotation_offset  = segment.rotationOffset;
+    m_transition_duration = segment.transitionDuration;
+    m_transition_time  = segment.transitionTime;
+    m_is_on            = segment.isOn;
+}
+
+void
+ArduCor::resetSegment()
+{
+    // By default, this is set to orange. However,
+    // most sample sketches will override this value
+    // during their setup.
+    m_main_color = {100, 25, 0};
+
+    // set user configurable settings
+    m_current_palette = eCustom;
+    m_current_routine = eSingleGlimmer;
+    m_brightness_flag = true;
+    m_bar_size     = DEFAULT_BAR_SIZE;
+    m_step_interval = DEFAULT_STEP_INTERVAL;
+    m_step_time    = 0;
+    // edge case for smaller LED arrays, rather than using multiple LEDs in a "bar"
+    // it defaults to one LED per bar.
+    if (m_LED_count < 32) {
+        m_bar_size = 1;
+    }
+
+    // set temp values
+    m_temp_index = 0;
+    m_temp_counter = 0;
+    m_temp_bool = true;
+    m_temp_color = {0, 0, 0};
+    m_is_on = true;
+    // make sure the next frame gets displayed
+    markDirty(0, m_LED_count - 1);
+
+    // set routine specific variables
+    memset(&m_state, 0, sizeof(m_state));
+}
+
+void
+ArduCor::invalidateBrightness()
+{
+    // the patterns that were dimmed once are drawn again with the new setting
+    m_brightness_flag = true;
+    m_pattern_valid = false;
+    m_fill_shown = false;
+    for (uint8_t i = 0; i < m_segment_count; ++i) {
+        m_segments[i].brightnessFlag = true;
+        m_segments[i].patternValid = false;
+        m_segments[i].fillShown = false;
+    }
+}
+
+void
+ArduCor::invalidateCustomPalette()
+{
+    // catch edge case
+    if (m_current_palette == eCustom) {
+        m_preprocess_flag = true;
+    }
+    // a segment copies its palette again each time it is selected, so a rotating view
+    // using the custom colors is drawn with the old colors before they change.
+    uint8_t selected = m_segment_index;
+    for (uint8_t i = 0; i < m_segment_count; ++i) {
+        selectSegment(i);
+        if (m_current_palette == eCustom) {
+            resolveRotation();
+            m_preprocess_flag = true;
+        }
+    }
+    selectSegment(selected);
+    // the copies of the custom colors compare their generation to this one, so the ones
+    // made above are copied again once the colors have changed. If it wraps around, an old
+    // copy could match it again, so every copy is made again.
+    if (++m_custom_generation == 0) {
+        m_temp_palette = ePalette_MAX;
+        m_gradient_palette = ePalette_MAX;
+    }
+}
+
+void
+ArduCor::copyBuffers(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count)
+{
+    size_t size = (size_t)count * 3;
+    if (m_interleaved && (order == m_color_order)) {
+        // already stored the way the destination wants it
+        memcpy(destination, m_frame_buffer + (size_t)first * 3, size);
+    } else {
+        uint8_t r, g, b;
+        channelOffsets(order, &r, &g, &b);
+        uint8_t stride = m_stride;
+        const uint8_t *red   = r_buffer + (size_t)first * stride;
+        const uint8_t *green = g_buffer + (size_t)first * stride;
+        const uint8_t *blue  = b_buffer + (size_t)first * stride;
+        for (LEDIndex i = 0; i < count; ++i) {
+            destination[r] = *red;
+            destination[g] = *green;
+            destination[b] = *blue;
+            destination += 3;
+            red   += stride;
+            green += stride;
+            blue  += stride;
+        }
+    }
+}
+
+void
+ArduCor::copyView(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count)
 {
-    if ((groupSize * colorCount) > m_LED_count) {
+    if (!m_is_on) {
+        memset(destination, 0, (size_t)count * 3);
+    } else if (m_rotation_length == 0) {
+        copyBuffers(destination, order, first, count);
+    } else {
+        // the rotated view is two runs of the buffers. LEDs before the split are read
+        // m_rotation_offset LEDs further along, the rest wrap around to one pattern
+        // length before that.
+        LEDIndex split = m_LED_count - m_rotation_offset;
+        LEDIndex headCount = 0;
+        if (first < split) {
+            headCount = (count < split - first) ? count : split - first;
+            copyBuffers(destination, order, first + m_rotation_offset, headCount);
+        }
+        if (count > headCount) {
+            LEDIndex tailFirst = first + headCount + m_rotation_offset - m_rotation_length;
+            copyBuffers(destination + (size_t)headCount * 3, order, tailFirst, count - headCount);
+        }
+    }
+}
+
+bool
+ArduCor::startRotation()
+{
+    LEDIndex loopLength = m_state.pattern.loopLength;
+    // the pattern moves one LED for each step, drawn or not
+    m_temp_index = (m_temp_index + skippedSteps()) % loopLength;
+    if (loopLength > m_LED_count) {
+        // the pattern is longer than the LEDs, so it can't be stored whole. Each frame
+        // is drawn as is, starting at the current point in the pattern.
+        m_rotation_length = 0;
+        m_pattern_valid = false;
+        m_temp_counter = m_temp_index % loopLength;
+        return true;
+    }
+    if (!m_pattern_valid) {
+        // draw the pattern from its start, the view is rotated into place afterwards.
+        m_temp_counter = 0;
+        m_pattern_dimmed = false;
+        return true;
+    }
+    return false;
+}
+
+void
+ArduCor::advanceRotation()
+{
+    LEDIndex loopLength = m_state.pattern.loopLength;
+    if (loopLength <= m_LED_count) {
+        m_rotation_length = loopLength;
+        m_rotation_offset = m_temp_index % loopLength;
+        m_pattern_valid = true;
+    }
+    m_frame_dimmed = false;
+    markDirty(0, m_LED_count - 1);
+    m_temp_index = (m_temp_index + 1) % loopLength;
+}
+
+void
+ArduCor::resolveRotation()
+{
+    if (m_rotation_length == 0) {
+        return;
+    }
+    // draw the current frame as is, dimmed if applyBrightness has run since the routine
+    m_temp_counter = m_rotation_offset;
+    drawFrame(m_frame_dimmed);
+    m_rotation_length = 0;
+    m_pattern_valid = false;
+    m_pattern_dimmed = false;
+}
+
+void
+ArduCor::resolveFrame()
+{
+    // only the segments showing a rotated view are selected, since selecting a segment
+    // copies its palette again
+    resolveRotation();
+    uint8_t selected = m_segment_index;
+    for (uint8_t i = 0; i < m_segment_count; ++i) {
+        if ((i != selected) && (m_segments[i].rotationLength != 0)) {
+            selectSegment(i);
+            resolveRotation();
+        }
+    }
+    selectSegment(selected);
+}
+
+void
+ArduCor::drawPattern(LEDIndex first, LEDIndex count)
+{
+    // loop through all the values of the pattern until every LED is set.
+    LEDIndex loopLength = m_state.pattern.loopLength;
+    LEDIndex end = first + count;
+    if (m_current_routine == eSingleWave) {
+        for (x = first; x < end; ++x) {
+            uint16_t level = m_temp_buffer[m_temp_counter];
+            setPixel(x,
+                     (uint8_t)((m_main_color.red * level) >> 8),
+                     (uint8_t)((m_main_color.green * level) >> 8),
+                     (uint8_t)((m_main_color.blue * level) >> 8));
+            // wrap around at the end of the looped values instead of dividing on every LED
+            if (++m_temp_counter == loopLength) {
+                m_temp_counter = 0;
+            }
+        }
+    } else {
+        for (x = first; x < end; ++x) {
+            const Color& color = m_temp_array[m_temp_buffer[m_temp_counter]];
+            setPixel(x, color.red, color.green, color.blue);
+            if (++m_temp_counter == loopLength) {
+                m_temp_counter = 0;
+            }
+        }
+    }
+}
+
+void
+ArduCor::drawFrame(bool dim)
+{
+    dim = dim && !isFullBrightness();
+    LEDIndex count;
+    for (LEDIndex first = 0; first < m_LED_count; first += count) {
+        count = m_LED_count - first;
+        if (count > RENDER_CHUNK_SIZE) {
+            count = RENDER_CHUNK_SIZE;
+        }
+        drawPattern(first, count);
+        if (dim) {
+            dimRange(first, count);
+        }
+    }
+}
+
+void
+ArduCor::movingBufferSetup(uint16_t colorCount, uint16_t groupSize, uint8_t startingValue)
+{
+    if (((uint32_t)groupSize * colorCount) > m_LED_count) {
         // edge case handled for memory reasons, a full loop must
         // take less than the m_LED_count
         groupSize = 1;
     }
     // minimum number of values needed for a looping pattern.
-    m_loop_index = groupSize * colorCount;
-    // minimum number of times we need to loop these values to
-    // completely fill the LEDs.
-    m_loop_count = ((m_LED_count / m_loop_index) + 1);
+    m_state.pattern.loopLength = (LEDIndex)groupSize * colorCount;
     // change the starting value for routines like singleWave
     if (startingValue < colorCount) {
         m_temp_index = startingValue;
@@ -678,8 +1908,8 @@ ArduCor::movingBufferSetup(uint16_t colorCount, uint8_t groupSize, uint8_t start
         startingValue = 0;
     }
 
-    //the buffer from 0 to m_loop_index with the proper bars
-    for (x = 0; x < m_loop_index; ++x) {
+    //the buffer from 0 to the loop length with the proper bars
+    for (x = 0; x < m_state.pattern.loopLength; ++x) {
         m_temp_buffer[x] = m_temp_index;
         m_temp_counter++;
         if (m_temp_counter == groupSize) {
@@ -693,23 +1923,260 @@ ArduCor::movingBufferSetup(uint16_t colorCount, uint8_t groupSize, uint8_t start
 }
 
 
+void
+ArduCor::setupGlimmer(uint8_t percent)
+{
+    if (percent == m_state.glimmer.percent) {
+        return;
+    }
+    m_state.glimmer.percent = percent;
+    // an LED glimmers with a chance of (percent - 1) / 100, which matches the check
+    // random(1, 101) < percent that the glimmer routines used to make for every LED.
+    uint32_t chance = 0;
+    if (percent > 1) {
+        chance = ((uint32_t)(percent - 1) << 16) / 100;
+    }
+    if (chance > 65536) {
+        chance = 65536;
+    }
+    // thresholds[k] holds the chance that the next k + 1 LEDs are all skipped,
+    // (1 - chance) ^ (k + 1), as a 16 bit fraction.
+    uint32_t threshold = 65536;
+    for (uint8_t k = 0; k < 8; ++k) {
+        threshold = (threshold * (65536 - chance)) >> 16;
+        m_state.glimmer.thresholds[k] = (threshold > 65535) ? 65535 : threshold;
+    }
+}
+
+uint32_t
+ArduCor::glimmerSkip()
+{
+    // the number of LEDs between glimmers follows a geometric distribution. A random
+    // value below the threshold for k LEDs means that at least k LEDs are skipped. Since
+    // the distribution has no memory, a skip of eight or more restarts with a new value.
+    const uint16_t *thresholds = m_state.glimmer.thresholds;
+    uint32_t skip = 0;
+    uint16_t value = nextRandom() >> 16;
+    while (value < thresholds[7]) {
+        skip += 8;
+        if (skip >= m_LED_count) {
+            return skip;
+        }
+        value = nextRandom() >> 16;
+    }
+    uint8_t k = 0;
+    while ((k < 7) && (value < thresholds[k])) {
+        ++k;
+    }
+    return skip + k;
+}
+
+void
+ArduCor::glimmerPass(bool changeColor)
+{
+    if (m_state.glimmer.percent <= 1) {
+        return;
+    }
+    LEDIndex first = m_LED_count;
+    LEDIndex last = 0;
+    // jump straight from one glimmering LED to the next instead of rolling for every LED
+    for (uint32_t i = glimmerSkip(); i < m_LED_count; i += glimmerSkip() + 1) {
+        if (changeColor) {
+            // m_temp_color is set in chooseRandomFromArray
+            chooseRandomFromArray(m_temp_array, m_temp_size, true);
+            setPixel(i, m_temp_color.red, m_temp_color.green, m_temp_color.blue);
+        } else {
+            // set a random level for the LED to be dimmed by.
+            uint8_t scaleFactor = (uint8_t)(2 + randomIndex(5));
+            size_t offset = i * m_stride;
+            setPixel(i,
+                     r_buffer[offset] / scaleFactor,
+                     g_buffer[offset] / scaleFactor,
+                     b_buffer[offset] / scaleFactor);
+        }
+        if (i < first) {
+            first = i;
+        }
+        last = i;
+    }
+    if (first <= last) {
+        markDirty(first, last);
+    }
+}
+
+void
+ArduCor::buildBrightnessTable()
+{
+    // Since applyBrightness is often run on every LED update, the integer math
+    // is done once per possible value here instead of once per LED.
+    for (uint16_t i = 0; i < 256; ++i) {
+        uint8_t value = i;
+        if (m_gamma_enabled) {
+            value = pgm_read_byte_near(gammaCurve + i);
+        }
+        m_brightness_table[i] = (uint8_t)((value * (uint16_t)m_bright_level) / 100);
+    }
+}
+
+void
+ArduCor::dimBuffers()
+{
+    // full brightness with no correction leaves the buffers untouched
+    if (isFullBrightness()) {
+        return;
+    }
+    if (m_fill_valid) {
+        // the frame is a single color, so only that color needs to be mapped. m_fill_color
+        // keeps the color as it was drawn, so the frame is only changed if the dimmed color
+        // differs from the one last shown.
+        if (m_fill_dimmed && m_fill_shown) {
+            return;
+        }
+        if (!m_fill_shown) {
+            markShown(0, m_LED_count - 1);
+        }
+        writeFill(applyBrightnessValue(m_brightness_table, m_white_balance.red, m_fill_color.red),
+                  applyBrightnessValue(m_brightness_table, m_white_balance.green, m_fill_color.green),
+                  applyBrightnessValue(m_brightness_table, m_white_balance.blue, m_fill_color.blue));
+        m_fill_dimmed = true;
+        m_fill_shown = true;
+        return;
+    }
+    markDirty(0, m_LED_count - 1);
+    if ((m_white_balance.red == 255)
+        && (m_white_balance.green == 255)
+        && (m_white_balance.blue == 255)
+        && (m_interleaved || (m_LED_count == m_strip_count))) {
+        // every channel uses the same table, so the whole frame is done in one pass
+        // as long as the segment's channels are next to each other.
+        applyBrightnessTable(m_frame_buffer, m_brightness_table, 255, (size_t)m_LED_count * 3, 1);
+    } else {
+        // the channels are done one chunk at a time, so on a long strip the second and
+        // third channel find the chunk in the cache instead of streaming the frame again.
+        LEDIndex count;
+        for (LEDIndex first = 0; first < m_LED_count; first += count) {
+            count = m_LED_count - first;
+            if (count > RENDER_CHUNK_SIZE) {
+                count = RENDER_CHUNK_SIZE;
+            }
+            dimRange(first, count);
+        }
+    }
+}
+
+void
+ArduCor::dimRange(LEDIndex first, LEDIndex count)
+{
+    size_t offset = (size_t)first * m_stride;
+    if (m_interleaved
+        && (m_white_balance.red == 255)
+        && (m_white_balance.green == 255)
+        && (m_white_balance.blue == 255)) {
+        applyBrightnessTable(m_frame_buffer + offset, m_brightness_table, 255, (size_t)count * 3, 1);
+    } else {
+        // each channel is run through the table on its own, which keeps the inner
+        // loop to a single lookup and a multiply.
+        applyBrightnessTable(r_buffer + offset, m_brightness_table, m_white_balance.red, count, m_stride);
+        applyBrightnessTable(g_buffer + offset, m_brightness_table, m_white_balance.green, count, m_stride);
+        applyBrightnessTable(b_buffer + offset, m_brightness_table, m_white_balance.blue, count, m_stride);
+    }
+}
+
 void
 ArduCor::fillColorBuffers(uint8_t r, uint8_t g, uint8_t b)
 {
-    memset(r_buffer, r, m_LED_count);
-    memset(g_buffer, g, m_LED_count);
-    memset(b_buffer, b, m_LED_count);
+    // skip the fill if the frame is already this color. If it has been dimmed since, the
+    // color is written again for the routine to draw on, but the frame only counts as
+    // changed if the brightness has changed since it was shown.
+    if (m_fill_valid
+        && (m_fill_color.red == r)
+        && (m_fill_color.green == g)
+        && (m_fill_color.blue == b)) {
+        if (m_fill_dimmed) {
+            if (!m_fill_shown) {
+                markShown(0, m_LED_count - 1);
+            }
+            writeFill(r, g, b);
+            m_fill_dimmed = false;
+        }
+        return;
+    }
+    markDirty(0, m_LED_count - 1);
+    m_fill_valid = true;
+    m_fill_dimmed = false;
+    m_fill_shown = false;
+    m_fill_color = {r, g, b};
+    // every LED gets drawn, so the frame is no longer rotated
+    m_rotation_length = 0;
+    m_pattern_valid = false;
+    writeFill(r, g, b);
+}
+
+void
+ArduCor::writeFill(uint8_t r, uint8_t g, uint8_t b)
+{
+    if (m_stride == 1) {
+        memset(r_buffer, r, m_LED_count);
+        memset(g_buffer, g, m_LED_count);
+        memset(b_buffer, b, m_LED_count);
+    } else {
+        // draw the first LED, then keep doubling the filled region by copying it
+        // onto the rest of the buffer.
+        setPixel(0, r, g, b);
+        size_t size = (size_t)m_LED_count * 3;
+        size_t filled = 3;
+        while (filled < size) {
+            size_t chunk = filled;
+            if (chunk > size - filled) {
+                chunk = size - filled;
+            }
+            memcpy(m_frame_buffer + filled, m_frame_buffer, chunk);
+            filled += chunk;
+        }
+    }
+}
+
+void
+ArduCor::markDirty(LEDIndex first, LEDIndex last)
+{
+    // the frame is no longer known to be a single color
+    m_fill_valid = false;
+    markShown(first, last);
+}
+
+void
+ArduCor::markShown(LEDIndex first, LEDIndex last)
+{
+    // changes while off aren't visible
+    if (!m_is_on) {
+        return;
+    }
+    // the changed range covers the whole strip
+    first += m_segment_first;
+    last += m_segment_first;
+    if (!m_frame_changed) {
+        m_dirty_first = first;
+        m_dirty_last = last;
+        m_frame_changed = true;
+    } else {
+        if (first < m_dirty_first) {
+            m_dirty_first = first;
+        }
+        if (last > m_dirty_last) {
+            m_dirty_last = last;
+        }
+    }
 }
 
 void
 ArduCor::chooseRandomFromArray(Color *array, uint8_t max_index, boolean canRepeat)
 {
-    m_possible_array_color = random(0, max_index);
+    uint8_t possibleColor = randomIndex(max_index);
     if (!canRepeat && max_index > 2) {
-      while (m_possible_array_color == m_temp_index) {
-         m_possible_array_color = (uint8_t)random(0, max_index);
+      while (possibleColor == m_temp_index) {
+         possibleColor = randomIndex(max_index);
       }
     }
-    m_temp_index = m_possible_array_color;
+    m_temp_index = possibleColor;
     m_temp_color = array[m_temp_index];
 }
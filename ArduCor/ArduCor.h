@@ -24,10 +24,16 @@
  * arduino sketch:
  *
  * ~~~~~~~~~~~~~~~~~~~~~
- * ArduCor routines = ArduCor(LED_COUNT);
+ * ArduCor routines(LED_COUNT);
  * ~~~~~~~~~~~~~~~~~~~~~
  *
- * where `LED_COUNT` is the number of LEDs in your array.
+ * where `LED_COUNT` is the number of LEDs in your array. If `LED_COUNT` is a constant, the
+ * buffers can be stored in the object instead of allocated when the sketch starts, which
+ * makes them part of the RAM usage reported when the sketch is compiled:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * StaticArduCor<LED_COUNT> routines;
+ * ~~~~~~~~~~~~~~~~~~~~~
  *
  * The library produces lighting routines based on the functions used and stores the routine
  * in its internal buffers. These buffers can then be accessed by getters and displayed
@@ -54,6 +60,17 @@
  * pixels.show();
  * ~~~~~~~~~~~~~~~~~~~~~
  *
+ * If the LED driver exposes its own buffer, the library can store the LEDs in the driver's
+ * channel order instead, so the whole frame is copied at once:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * ArduCor routines(LED_COUNT, ArduCor::eOrderGRB);
+ * ...
+ * routines.applyBrightness();
+ * routines.copyFrame(pixels.getPixels(), ArduCor::eOrderGRB, 0, LED_COUNT);
+ * pixels.show();
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
  * By this point, the LEDs should be showing red. To achieve the blink effect, put both of
  * these in your `loop()` function and then put a delay between updates. This delay will
  * be used to determine how fast the LED's blink.
@@ -76,15 +93,60 @@ public:
         uint8_t blue;
     };
 
+    // index or count of LEDs. It is 16 bits unless ARDUCOR_LARGE_STRIP is defined, which
+    // allows strips longer than 65535 LEDs at the cost of 32 bit math in the render loops.
+#ifdef ARDUCOR_LARGE_STRIP
+    typedef uint32_t LEDIndex;
+#else
+    typedef uint16_t LEDIndex;
+#endif
+
+    // order of the channels of an LED when they are stored or sent together.
+    enum EColorOrder
+    {
+        eOrderRGB,
+        eOrderGRB,
+        eOrderBGR
+    };
+
     /*!
      * Required constructor. The library should be stored in
      * global memory and allocated only once at startup.
      *
-     * It will allocate `4 * ledCount` bytes.
+     * It will allocate `4 * ledCount` bytes, on top of a 256 byte brightness
+     * table that is part of the object itself. Some features allocate more the first
+     * time they are used:
+     *  - `setupSegments()`, for the state of each segment and, if the segments' parts of
+     *    the temp buffer don't fit in the one it has, a new temp buffer.
+     *  - `startTransition()`, for a copy of the frame, which is freed once no segment
+     *    is in a transition.
+     *  - `paletteGradient()`, for its table of 768 bytes.
+     *
+     * The object can't be copied, since the copy would share its buffers.
+     *
+     * \param ledCount number of individual RGB LEDs. Strips longer than 65535 LEDs need
+     *        the library built with ARDUCOR_LARGE_STRIP defined.
+     */
+    ArduCor(LEDIndex ledCount);
+
+    /*!
+     * Constructor that stores the LEDs interleaved, three bytes per LED in the given
+     * channel order. Use the order that the LED driver expects on the wire, such as
+     * eOrderGRB for most NeoPixels, and the frame can be copied straight into the
+     * driver's buffer with `frameBuffer()` and `frameBufferSize()`.
+     *
+     * It allocates the same amount of memory as the planar constructor.
      *
      * \param ledCount number of individual RGB LEDs.
+     * \param order the channel order used to store each LED.
      */
-    ArduCor(uint16_t ledCount);
+    ArduCor(LEDIndex ledCount, EColorOrder order);
+
+    /*!
+     * Frees the buffers the object allocated. Buffers given to it, such as the ones of a
+     * StaticArduCor, are left alone.
+     */
+    ~ArduCor();
 
     /*!
      * Resets all internal values to the original values.
@@ -155,6 +217,29 @@ public:
      */
     int brightness() { return m_bright_level; }
 
+    /*!
+     * Turns gamma correction on or off. When it is on, `applyBrightness()` maps each value
+     * through a gamma curve of 2.2 so that fades and dim colors look even to the eye. The
+     * curve is folded into the brightness table, so it adds no cost per LED.
+     */
+    void gammaCorrection(bool enabled);
+
+    /*!
+     * Returns true if gamma correction is applied by `applyBrightness()`.
+     */
+    bool gammaCorrection() { return m_gamma_enabled; }
+
+    /*!
+     * Sets a per channel scale applied by `applyBrightness()`, where 255 leaves the channel
+     * unchanged. Useful for LEDs with a strong blue or green tint. Defaults to {255, 255, 255}.
+     */
+    void whiteBalance(uint8_t r, uint8_t g, uint8_t b);
+
+    /*!
+     * Retrieve the per channel scale used for white balance.
+     */
+    Color whiteBalance() { return m_white_balance; }
+
     /*!
      * Retrieve the main color, which is used for single color routines.
      */
@@ -168,17 +253,524 @@ public:
     /*!
      * Retrieve the r value at a given index in the buffer.
      */
-    uint8_t red(uint16_t i);
+    uint8_t red(LEDIndex i);
 
     /*!
      * Retrieve the g value at a given index in the buffer.
      */
-    uint8_t green(uint16_t i);
+    uint8_t green(LEDIndex i);
 
     /*!
      * Retrieve the b value at a given index in the buffer.
      */
-    uint8_t blue(uint16_t i);
+    uint8_t blue(LEDIndex i);
+
+    /*!
+     * Copies a range of LEDs into a buffer as three bytes per LED in the given channel order.
+     * The bounds and `isOn()` are checked once for the whole range, so this is much cheaper
+     * than calling `red()`, `green()` and `blue()` for every LED. If the LEDs are off, the
+     * range is filled with black. Transitions and layers are blended in here, so the
+     * getters don't include them.
+     *
+     * \param destination buffer that receives the LEDs, must hold at least `3 * count` bytes.
+     * \param order the channel order expected by the destination.
+     * \param first index of the first LED to copy.
+     * \param count number of LEDs to copy. It is clamped to the LEDs that exist.
+     * \return the number of LEDs copied.
+     */
+    LEDIndex copyFrame(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count);
+
+    /*!
+     * Returns true if anything visible has changed since the last call to
+     * `clearFrameChanged()`. Routines often produce the same frame for long stretches, such
+     * as singleSolid after its first frame or singleBlink between toggles. When this
+     * returns false, the output stage can skip updating the LEDs entirely. Changes to the
+     * layers count as changes to the frame.
+     */
+    bool frameChanged();
+
+    /*!
+     * Retrieve the index of the first LED that changed since the last call to
+     * `clearFrameChanged()`. Only valid when `frameChanged()` is true.
+     */
+    LEDIndex changedFirst();
+
+    /*!
+     * Retrieve the index of the last LED that changed since the last call to
+     * `clearFrameChanged()`. Only valid when `frameChanged()` is true.
+     */
+    LEDIndex changedLast();
+
+    /*!
+     * Marks the current frame, and the frames of the layers, as displayed. Call this after
+     * the LEDs are updated.
+     */
+    void clearFrameChanged();
+
+    /*!
+     * Retrieve the interleaved frame, `frameBufferSize()` bytes long, in the channel order
+     * given to the constructor. Returns 0 if the LEDs are stored in separate planes.
+     *
+     * Unlike the per LED getters, this doesn't check `isOn()`. Routines keep drawing while
+     * the LEDs are off, so the output stage should send black when `isOn()` is false. It
+     * doesn't include the layers either, which are only blended by `copyFrame()`.
+     *
+     * singleWave and multiBars draw their pattern once and then only move a rotating
+     * view of it, which the getters and `copyFrame()` read directly. This function has to
+     * rotate the frame into place first, so `copyFrame()` is cheaper for those routines.
+     */
+    uint8_t* frameBuffer()
+    {
+        if (!m_interleaved) {
+            return 0;
+        }
+        resolveFrame();
+        return m_strip_buffer;
+    }
+
+    /*!
+     * Retrieve the size of the frame in bytes, three for every LED.
+     */
+    size_t frameBufferSize() { return (size_t)m_strip_count * 3; }
+
+    /*!
+     * Returns true if the LEDs are stored interleaved and `frameBuffer()` can be used.
+     */
+    bool isInterleaved() { return m_interleaved; }
+
+    /*!
+     * Retrieve the channel order of an interleaved frame.
+     */
+    EColorOrder colorOrder() { return m_color_order; }
+
+    /*!
+     * Seeds the random number generator used by the glimmer and random routines. The same
+     * seed always produces the same frames, which is useful for tests and benchmarks. For
+     * different frames on each boot, seed it with something like `analogRead()` of an
+     * unconnected pin.
+     *
+     * \param seed any value. 0 is replaced by the default seed.
+     */
+    void seedRandom(uint32_t seed);
+
+    /*!
+     * Fills a buffer with bytes from the random number generator, four bytes per step
+     * of the generator.
+     *
+     * \param buffer the buffer to fill.
+     * \param count the number of bytes to write.
+     */
+    void randomBytes(uint8_t *buffer, uint16_t count);
+
+    /*!
+     * Retrieve a random value between 0 and `count - 1`. Uses a multiply and a shift
+     * instead of a divide, so it is cheap enough to call for every LED.
+     *
+     * \param count the number of possible values. Returns 0 if it is 0.
+     */
+    uint16_t randomIndex(uint16_t count);
+
+    /*!
+     * Sets how long each step of a routine takes when it is run with the elapsed time, such
+     * as how long the wave takes to move one LED. Each segment has its own.
+     *
+     * \param milliseconds the time of a step, at least 1.
+     */
+    void stepInterval(uint16_t milliseconds);
+
+    /*!
+     * Retrieve how long each step of a routine takes, in milliseconds.
+     */
+    uint16_t stepInterval() { return m_step_interval; }
+
+    /*! @} */
+    //================================================================================
+    // Segments
+    //================================================================================
+    /*! @defgroup segments Segments
+     *  A strip can be split into segments that each run their own routine on their own
+     *  range of LEDs. All segments draw into the same frame, so a split strip still takes a
+     *  single `copyFrame()` to display:
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * routines.setupSegments(2);
+     * ...
+     * routines.selectSegment(0);
+     * routines.singleWave(0, 255, 0);
+     * routines.applyBrightness();
+     * routines.selectSegment(1);
+     * routines.multiBars(eFire, 4);
+     * routines.applyBrightness();
+     * routines.copyFrame(pixels.getPixels(), ArduCor::eOrderGRB, 0, LED_COUNT);
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *
+     *  The routines, the per LED getters, `drawColor()`, `applyBrightness()`, the main color
+     *  and turning the LEDs on and off all act on the selected segment, with LED indices
+     *  counted from the start of the segment. `copyFrame()`, `frameBuffer()` and the
+     *  changed range always cover the whole strip. The brightness, gamma correction, white
+     *  balance and custom colors are shared by every segment.
+     *  @{
+     */
+
+    /*!
+     * Splits the LEDs into segments. Each segment starts with the default routine and
+     * settings, so this should be called once in `setup()`. It allocates about 60 bytes
+     * per segment, plus up to 10 bytes per segment for routines that draw a pattern.
+     *
+     * \param count the number of segments, at least 1.
+     * \param lengths the number of LEDs in each segment, in order along the strip. They must
+     *        add up to the number of LEDs. If 0, the LEDs are split evenly and the last
+     *        segment gets any that are left over.
+     * \return true if the segments are set up, false if the lengths don't fit the LEDs or
+     *         the memory couldn't be allocated.
+     */
+    bool setupSegments(uint8_t count, const LEDIndex *lengths = 0);
+
+    /*!
+     * Chooses the segment that the routines and settings act on until the next call.
+     * Switching costs a copy of the segment's state, not a copy of its LEDs.
+     *
+     * \param index the segment, less than `segmentCount()`.
+     * \return true if the segment exists and is selected, false otherwise.
+     */
+    bool selectSegment(uint8_t index);
+
+    /*!
+     * Retrieve the index of the selected segment.
+     */
+    uint8_t selectedSegment() { return m_segment_index; }
+
+    /*!
+     * Retrieve the number of segments. A strip that hasn't been split is one segment.
+     */
+    uint8_t segmentCount() { return m_segment_count ? m_segment_count : 1; }
+
+    /*!
+     * Retrieve the index of the first LED of a segment within the strip.
+     */
+    LEDIndex segmentOffset(uint8_t index);
+
+    /*!
+     * Retrieve the number of LEDs in a segment.
+     */
+    LEDIndex segmentLength(uint8_t index);
+
+    /*! @} */
+    //================================================================================
+    // Layers
+    //================================================================================
+    /*! @defgroup layers Layers
+     *  Other ArduCor objects can be stacked on top of this one as layers, each running its
+     *  own routine. `copyFrame()` blends them onto this object's frame in order, so a
+     *  glimmer can shine over bars:
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * StaticArduCor<LED_COUNT> overlay(ArduCor::eOrderGRB);
+     * const ArduCor::Layer layers[] = { { &overlay, ArduCor::eBlendAlpha, 77 } };
+     * ...
+     * routines.setLayers(layers, 1);
+     * ...
+     * routines.multiBars(eFire, 4);
+     * routines.applyBrightness();
+     * overlay.singleGlimmer(255, 255, 255, 30);
+     * overlay.applyBrightness();
+     * routines.copyFrame(pixels.getPixels(), ArduCor::eOrderGRB, 0, LED_COUNT);
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *
+     *  Each layer is drawn once by its routine. The blend is done while the frame is copied,
+     *  a small chunk of LEDs at a time, so every layer is blended into the chunk while it is
+     *  still in the cache instead of in its own pass over the whole frame.
+     *  @{
+     */
+
+    // how a layer is combined with the frame below it.
+    enum EBlendMode
+    {
+        // adds the layer to the frame, capped at full brightness.
+        eBlendAdd,
+        // keeps the brighter of the layer and the frame for each channel.
+        eBlendMax,
+        // covers the frame with the layer.
+        eBlendAlpha,
+        // darkens the frame by the layer, where full brightness leaves the frame unchanged.
+        eBlendMultiply
+    };
+
+    // an object whose frame is blended on top of this one.
+    struct Layer
+    {
+        // the layer's routines. They should have as many LEDs as this object, and must not
+        // be this object.
+        ArduCor   *routines;
+        EBlendMode mode;
+        // how strongly the layer is blended, 255 is fully and 0 leaves the layer out.
+        uint8_t    opacity;
+    };
+
+    /*!
+     * Sets the layers blended on top of this object by `copyFrame()`, from the bottom up.
+     * The table isn't copied, so it must stay valid for as long as it is used. A layer's
+     * LEDs are blended as `copyFrame()` returns them, so a layer that is off blends black.
+     *
+     * \param layers the layers, or 0 to remove them.
+     * \param count the number of layers in the table.
+     */
+    void setLayers(const Layer *layers, uint8_t count);
+
+    /*!
+     * Retrieve the number of layers blended on top of this object.
+     */
+    uint8_t layerCount() { return m_layer_count; }
+
+    /*! @} */
+    //================================================================================
+    // Transitions
+    //================================================================================
+    /*! @defgroup transitions Transitions
+     *  A new routine normally replaces the last one on its first frame. A transition fades
+     *  from the last frame of the old routine into the new one instead:
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * routines.startTransition(1000);
+     * ...
+     * if (routines.runRoutine(eMultiBars, eFire, 4, elapsed)) {
+     *     routines.applyBrightness();
+     *     ...
+     * }
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *
+     *  The old frame is kept as it was shown, so the old routine stops moving while the
+     *  new one fades in. It needs one more frame buffer, which is only allocated while a
+     *  transition is running. Each segment has its own transition.
+     *  @{
+     */
+
+    /*!
+     * Starts fading the selected segment from what it shows now into whatever is drawn
+     * next. Call it before switching to the new routine. Starting a transition while one
+     * is running fades from the mix that is shown.
+     *
+     * \param duration milliseconds the fade takes.
+     * \return true if the transition started, false if the duration is 0 or the frame
+     *         couldn't be stored, in which case the new routine replaces the old one at once.
+     */
+    bool startTransition(uint16_t duration);
+
+    /*!
+     * Moves the transition of the selected segment forward. The timed `runRoutine()` does
+     * this, so it only needs to be called while a segment's routine isn't run, such as when
+     * it is paused. The untimed `runRoutine()` moves it forward by one `stepInterval()`.
+     *
+     * \param elapsed the milliseconds since the transition was last moved forward.
+     * \return true if the segment is in a transition. The fade only changes what
+     *         `copyFrame()` returns, so it is counted by `frameChanged()` rather than
+     *         drawn, and `applyBrightness()` isn't needed for it.
+     */
+    bool advanceTransition(uint32_t elapsed);
+
+    /*!
+     * Returns true if the selected segment is fading in from its last routine.
+     */
+    bool inTransition() { return m_transition_duration != 0; }
+
+    /*! @} */
+    //================================================================================
+    // Routines
+    //================================================================================
+    /*! @defgroup routines Routines
+     *  Every routine can also be run by its ERoutine value, which suits sketches that
+     *  receive the routine as a number, such as over serial:
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * routines.setMainColor(0, 255, 0);
+     * ...
+     * routines.runRoutine(eSingleGlimmer, eCustom, 15);
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *  @{
+     */
+
+    /*!
+     * Draws the next frame of a routine. The routine is set up only when it, its palette or
+     * its settings change, so calling this on every frame costs the same as calling the
+     * routine's own function.
+     *
+     * \param routine the routine to draw, an ERoutine or the value of a custom routine.
+     * \param palette the palette used by multi color routines. Single color routines ignore
+     *        it and draw with `mainColor()`.
+     * \param parameter the routine's setting, if it has one: the percent for eSingleGlimmer
+     *        and eMultiGlimmer, 1 for a sine fade in eSingleFade, 1 to fade in for
+     *        eSingleSawtoothFade and the bar size for eMultiBars. Custom routines are given
+     *        it as is and the other routines ignore it.
+     */
+    void runRoutine(uint8_t routine, EPalette palette, uint16_t parameter);
+
+    /*!
+     * Moves a routine forward by the time since it was last run and draws its frame, so
+     * it runs at the same speed no matter how long drawing and sending each frame takes.
+     * A step is taken every `stepInterval()` milliseconds, and the steps that are due are
+     * added up instead of each being drawn. If no step is due, nothing is drawn. A new
+     * routine, palette or setting is drawn right away.
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * unsigned long now = millis();
+     * if (routines.runRoutine(eSingleWave, eCustom, 0, now - lastFrame)) {
+     *     routines.applyBrightness();
+     *     ...
+     * }
+     * lastFrame = now;
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *
+     * \param routine the routine to draw, an ERoutine or the value of a custom routine.
+     * \param palette the palette used by multi color routines.
+     * \param parameter the routine's setting, as described for the other `runRoutine()`.
+     * \param elapsed the milliseconds since the last call.
+     * \return true if a frame was drawn, in which case `applyBrightness()` should be called
+     *         before it is displayed. false if the frame hasn't changed.
+     */
+    bool runRoutine(uint8_t routine, EPalette palette, uint16_t parameter, uint32_t elapsed);
+
+    /*!
+     * Makes the selected segment set its routine up again on the next `runRoutine()`, so
+     * that frame is drawn from scratch. Useful after something else drew over the routine.
+     */
+    void restartRoutine() { m_preprocess_flag = true; }
+
+    /*! @} */
+    //================================================================================
+    // Custom Routines
+    //================================================================================
+    /*! @defgroup customRoutines Custom Routines
+     *  A sketch can add its own routines next to the built in ones. Each routine is a
+     *  CustomRoutine with a setup and a draw function, and the table of them is given to
+     *  `setCustomRoutines()`. They take the routine values after the built in routines,
+     *  starting at eRoutine_MAX, and are run by `runRoutine()` like any other routine:
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~
+     * void drawChase(ArduCor& lights, uint16_t spacing) { ... }
+     * const ArduCor::CustomRoutine customRoutines[] = { { 0, drawChase, true } };
+     * ...
+     * routines.setCustomRoutines(customRoutines, 1);
+     * ...
+     * routines.runRoutine(eRoutine_MAX, eFire, 4);
+     * ~~~~~~~~~~~~~~~~~~~~~
+     *
+     *  The draw function uses the functions of this group to read the palette and to draw
+     *  into the frame. They skip the checks of `drawColor()`, so they cost the same as they
+     *  do for the built in routines. `applyBrightness()` dims routines that use the palette
+     *  and leaves the others at full brightness, like it does for the built in routines. It
+     *  dims the frame in place, so a routine that uses the palette has to draw every LED on
+     *  every frame.
+     *  @{
+     */
+
+    // a routine added by the sketch.
+    struct CustomRoutine
+    {
+        // called once when the routine starts, after the palette is set up. 0 if the
+        // routine needs nothing else.
+        void (*setup)(ArduCor& routines);
+        // called on every frame with the parameter given to runRoutine().
+        void (*draw)(ArduCor& routines, uint16_t parameter);
+        // true if the routine draws with the palette, false if it draws with `mainColor()`.
+        boolean usesPalette;
+    };
+
+    // number of bytes that `routineState()` points to.
+    enum { ROUTINE_STATE_SIZE = 16 };
+
+    /*!
+     * Sets the routines added by the sketch. The table isn't copied, so it must stay valid
+     * for as long as the routines are used, such as a global constant.
+     *
+     * \param customRoutines the routines. The first gets the routine value eRoutine_MAX,
+     *        the next eRoutine_MAX + 1 and so on.
+     * \param count the number of routines in the table. At most 255 - eRoutine_MAX.
+     */
+    void setCustomRoutines(const CustomRoutine *customRoutines, uint8_t count);
+
+    /*!
+     * Retrieve the number of routines added by the sketch.
+     */
+    uint8_t customRoutineCount() { return m_custom_routine_count; }
+
+    /*!
+     * Returns true if a routine draws with the palette, false if it draws with `mainColor()`
+     * or doesn't exist.
+     *
+     * \param routine a built in or custom routine.
+     */
+    bool isMultiColor(uint8_t routine);
+
+    /*!
+     * Retrieve the number of LEDs in the selected segment.
+     */
+    LEDIndex ledCount() { return m_LED_count; }
+
+    /*!
+     * Retrieve the number of colors in the palette of the current routine.
+     */
+    uint8_t paletteSize() { return m_temp_size; }
+
+    /*!
+     * Retrieve a color of the palette of the current routine.
+     *
+     * \param i the index of the color, less than `paletteSize()`.
+     */
+    Color paletteColor(uint8_t i) { return m_temp_array[i]; }
+
+    /*!
+     * Retrieve a table of 256 colors that blends smoothly through the palette of the current
+     * routine, so a routine can pick a color with an 8 bit phase instead of blending colors
+     * itself. Each palette color gets an equal part of the table, and the last color blends
+     * back into the first, so the phase can wrap around.
+     *
+     * The table takes 768 bytes, which are allocated the first time it is used. It is shared
+     * by every segment and is built again when the palette differs from the one it was built
+     * for, or when the custom colors used by it change.
+     *
+     * \return the table, or 0 if it couldn't be allocated.
+     */
+    const Color* paletteGradient();
+
+    /*!
+     * Sets every LED of the selected segment to one color. It does nothing if the LEDs
+     * already are that color, so it is cheap to call on every frame.
+     */
+    void fill(uint8_t red, uint8_t green, uint8_t blue) { fillColorBuffers(red, green, blue); }
+
+    /*!
+     * Sets the color of an LED without any bounds checking. `markChanged()` must be called
+     * for the LEDs drawn this way once the frame is drawn.
+     *
+     * \param i the index of the LED, less than `ledCount()`.
+     */
+    void setPixel(LEDIndex i, uint8_t red, uint8_t green, uint8_t blue)
+    {
+        size_t offset = (size_t)i * m_stride;
+        r_buffer[offset] = red;
+        g_buffer[offset] = green;
+        b_buffer[offset] = blue;
+    }
+
+    /*!
+     * Adds a range of LEDs drawn with `setPixel()` to the changed range.
+     *
+     * \param first index of the first LED that was drawn.
+     * \param last index of the last LED that was drawn.
+     */
+    void markChanged(LEDIndex first, LEDIndex last) { markDirty(first, last); }
+
+    /*!
+     * Retrieve ROUTINE_STATE_SIZE bytes that a custom routine can keep between frames.
+     * They are set to 0 when the routine starts and each segment has its own.
+     */
+    uint8_t* routineState() { return m_state.custom; }
+
+    /*!
+     * Retrieve the number of steps the routine has to move on this frame. It is 1 unless
+     * the routine is run with the elapsed time and more than one step was due.
+     */
+    uint16_t routineSteps() { return m_steps; }
 
     /*! @} */
     //================================================================================
@@ -325,7 +917,7 @@ public:
      *        all other values are preset groups.
      * \param barSize how many LEDs before switching to the other bar.
      */
-    void multiBars(EPalette palette, uint8_t barSizeSetting);
+    void multiBars(EPalette palette, uint16_t barSizeSetting);
 
     /*! @} */
     //================================================================================
@@ -339,8 +931,9 @@ public:
 
     /*!
      * This function takes the brightness() value given to the routines object and applies
-     * it to every LED. Relatively speaking, this is a pretty expensive operation so it is
-     * left optional.
+     * it to every LED, along with gamma correction and white balance if they are set. The
+     * scaling is precomputed into a table whenever the settings change, so each channel of
+     * each LED costs one table lookup.
      */
     void applyBrightness();
 
@@ -354,11 +947,42 @@ public:
      * \param blue the new blue value of the LED, between 0 and 255.
      * \return true if index exists and the color was drawn, false otherwise.
      */
-    bool drawColor(uint16_t i, uint8_t red, uint8_t green, uint8_t blue);
+    bool drawColor(LEDIndex i, uint8_t red, uint8_t green, uint8_t blue);
+
+    /*!
+     * Draws colors made outside of the library, such as a frame streamed from a gateway,
+     * on a range of LEDs of the selected segment. The colors are drawn as they are given,
+     * without brightness, gamma correction or white balance.
+     *
+     * \param first index of the first LED.
+     * \param count number of LEDs to draw. LEDs past the end of the segment are skipped.
+     * \param colors the red, green and blue value of each LED.
+     * \param step number of bytes from the color of one LED to the next, 3 for a color for
+     *        each LED or 0 to draw every LED with the first color.
+     * \return the number of LEDs drawn.
+     */
+    LEDIndex drawColors(LEDIndex first, LEDIndex count, const uint8_t *colors, uint8_t step);
 
     /*! @} */
+protected:
+
+    /*!
+     * Constructor that uses buffers provided by the caller instead of allocating them.
+     * Used by StaticArduCor.
+     *
+     * \param ledCount number of individual RGB LEDs.
+     * \param interleaved true to store the channels of each LED together.
+     * \param order channel order used when interleaved.
+     * \param frameStorage buffer of `3 * ledCount` bytes for the frame.
+     * \param tempStorage buffer of `ledCount` bytes, and at least 10, for the patterns.
+     */
+    ArduCor(LEDIndex ledCount, bool interleaved, EColorOrder order, uint8_t *frameStorage, uint8_t *tempStorage);
+
 private:
 
+    ArduCor(const ArduCor&);
+    ArduCor& operator=(const ArduCor&);
+
     // used by multi color routines to store their colors.
     Color    m_temp_array[10];
     // stores the user's settings for custom colors.
@@ -368,19 +992,88 @@ private:
     uint8_t  m_custom_count;
 
     // these variables are checked in every preproces step
-    ERoutine  m_current_routine;
+    uint8_t   m_current_routine;
     EPalette  m_current_palette;
 
+    // routines added by the sketch, run after the built in routines.
+    const CustomRoutine *m_custom_routines;
+    uint8_t  m_custom_routine_count;
+
+    // objects blended on top of this one by copyFrame().
+    const Layer *m_layers;
+    uint8_t  m_layer_count;
+
+    // table built by paletteGradient(), and the palette it was built for. ePalette_MAX if
+    // it has to be built again.
+    Color   *m_gradient;
+    EPalette m_gradient_palette;
+    uint8_t  m_gradient_generation;
+
+    // frames of the old routines, stored with three bytes per LED in RGB order. Only
+    // allocated while m_transition_count segments are in a transition.
+    uint8_t *m_transition_buffer;
+    uint8_t  m_transition_count;
+    // length of the selected segment's transition, and how much of it has passed. The
+    // duration is 0 if the segment isn't in a transition.
+    uint16_t m_transition_duration;
+    uint16_t m_transition_time;
+
+    // palette that m_temp_array holds, and the custom color generation it was copied at.
+    // ePalette_MAX if it has to be copied again.
+    EPalette m_temp_palette;
+    uint8_t  m_temp_generation;
+    // counts the changes to the custom colors, so a copy of them can tell if it is current.
+    uint8_t  m_custom_generation;
+
     // used for single color routines
     Color m_main_color;
 
-    // buffers used for storing the RGB LED values
+    // buffer used for storing the RGB LED values of the whole strip, three bytes per LED.
+    uint8_t *m_strip_buffer;
+    // false if m_strip_buffer was provided to the constructor rather than allocated.
+    boolean  m_owns_strip_buffer;
+    LEDIndex m_strip_count;
+    // the part of m_strip_buffer used by the selected segment. m_frame_buffer is only
+    // used for the whole segment at once when the LEDs are interleaved or the segment is
+    // the whole strip.
+    uint8_t *m_frame_buffer;
+    // the first value of each channel of the selected segment. The value for LED i is at
+    // index i * m_stride, so planar storage has a stride of 1 and interleaved has 3.
     uint8_t *r_buffer;
     uint8_t *g_buffer;
     uint8_t *b_buffer;
+    uint8_t  m_stride;
+    boolean  m_interleaved;
+    EColorOrder m_color_order;
+
+    // range of LEDs changed since the frame was last displayed.
+    boolean  m_frame_changed;
+    LEDIndex m_dirty_first;
+    LEDIndex m_dirty_last;
+    // if m_fill_valid is true, every LED in the buffer is m_fill_color, or m_fill_color
+    // with the brightness applied if m_fill_dimmed is true. m_fill_shown is true if the
+    // frame was last shown as m_fill_color dimmed with the current brightness.
+    boolean  m_fill_valid;
+    boolean  m_fill_dimmed;
+    boolean  m_fill_shown;
+    Color    m_fill_color;
 
-    // settings and stored values
-    uint16_t m_LED_count;
+    // routines that move their pattern one LED each frame draw it once and then rotate
+    // a view of it. While m_rotation_length is nonzero, LED i is read from the buffers at
+    // i + m_rotation_offset, or one m_rotation_length back from there if that is past the
+    // last LED. The buffers repeat every m_rotation_length LEDs, so both are the same LED
+    // of the pattern.
+    LEDIndex m_rotation_length;
+    LEDIndex m_rotation_offset;
+    // true if the buffers hold the pattern from its start, so the next frame only moves the view.
+    boolean  m_pattern_valid;
+    // true if applyBrightness has already been applied to the pattern.
+    boolean  m_pattern_dimmed;
+    // true if applyBrightness has run since the routine last moved the view.
+    boolean  m_frame_dimmed;
+
+    // settings and stored values. m_LED_count is the number of LEDs in the selected segment.
+    LEDIndex m_LED_count;
     uint16_t m_bar_size;
     uint16_t m_bright_level;
     uint8_t  m_fade_speed;
@@ -389,51 +1082,410 @@ private:
     boolean  m_preprocess_flag;
     boolean  m_is_on;
 
-    // temp values
+    // time of a step in milliseconds, and the time that has passed since the last step.
+    uint16_t m_step_interval;
+    uint16_t m_step_time;
+    // number of steps taken by the frame being drawn.
+    uint16_t m_steps;
+
+    // brightness post-processing. The table maps an input value to its output
+    // value with the brightness level and gamma curve already applied.
+    uint8_t  m_brightness_table[256];
+    boolean  m_gamma_enabled;
+    Color    m_white_balance;
+
+    // temp values. m_temp_buffer is the selected segment's part of m_temp_storage.
+    uint8_t *m_temp_storage;
+    LEDIndex m_temp_storage_size;
+    // false if m_temp_storage was provided to the constructor rather than allocated.
+    boolean  m_owns_temp_storage;
     uint8_t *m_temp_buffer;
-    uint16_t m_temp_counter;
-    uint16_t m_temp_index;
+    LEDIndex m_temp_counter;
+    LEDIndex m_temp_index;
     boolean  m_temp_bool;
     Color    m_temp_color;
     uint8_t  m_temp_size;
-    uint8_t  m_temp_goal;
-    int      m_temp_step;
-    float    m_temp_float;
-
-    // variables used by specific routines
-    Color    m_goal_color;
-    int      m_red_diff;
-    int      m_green_diff;
-    int      m_blue_diff;
-    uint8_t  m_fade_counter;
-    uint16_t m_loop_index;
-    uint8_t  m_loop_count;
-    uint8_t  m_scale_factor;
-    uint8_t  m_repeat_index;
-
-    uint8_t  m_possible_array_color;
+
+    // variables used by specific routines. Only one routine runs at a time, so they share
+    // their memory. Each routine's setup function sets up its part when the routine starts.
+    union RoutineState
+    {
+        // singleWave and multiBars
+        struct
+        {
+            // number of LEDs before the pattern in m_temp_buffer repeats.
+            LEDIndex loopLength;
+        } pattern;
+        // multiFade
+        struct
+        {
+            // color that the fade is heading towards.
+            Color    goal;
+            uint8_t  counter;
+        } fade;
+        // singleGlimmer and multiGlimmer
+        struct
+        {
+            // glimmer percent that thresholds was built for.
+            uint8_t  percent;
+            // chance that the next 1 to 8 LEDs all skip the glimmer effect, as 16 bit fractions.
+            uint16_t thresholds[8];
+        } glimmer;
+        // custom routines
+        uint8_t custom[ROUTINE_STATE_SIZE];
+    };
+    RoutineState m_state;
+
+    // state of the xorshift random number generator. It is never 0.
+    uint32_t m_random_state;
+
+    // the routine state of a segment while another segment is selected. The selected
+    // segment keeps its state in the members above, so the routines don't need to know
+    // about segments. Values that can be rebuilt, like m_temp_array from the palette,
+    // aren't stored.
+    struct Segment
+    {
+        LEDIndex first;
+        LEDIndex count;
+        // index of the segment's part of m_temp_storage.
+        LEDIndex tempFirst;
+        uint8_t  routine;
+        EPalette palette;
+        Color    mainColor;
+        Color    fillColor;
+        Color    tempColor;
+        uint16_t barSize;
+        LEDIndex rotationLength;
+        LEDIndex rotationOffset;
+        LEDIndex tempCounter;
+        LEDIndex tempIndex;
+        uint16_t stepInterval;
+        uint16_t stepTime;
+        uint16_t transitionDuration;
+        uint16_t transitionTime;
+        RoutineState state;
+        boolean  isOn;
+        boolean  brightnessFlag;
+        boolean  preprocessFlag;
+        boolean  fillValid;
+        boolean  fillDimmed;
+        boolean  fillShown;
+        boolean  patternValid;
+        boolean  patternDimmed;
+        boolean  frameDimmed;
+        boolean  tempBool;
+    };
+    // 0 if the strip hasn't been split, in which case m_segments is 0 as well.
+    Segment *m_segments;
+    uint8_t  m_segment_count;
+    uint8_t  m_segment_index;
+    // index of the first LED of the selected segment within the strip.
+    LEDIndex m_segment_first;
 
     // index for loops and other iterators
-    uint16_t x;
+    LEDIndex x;
+
+    /*!
+     * Allocates the frame and temp buffers and points each channel at its
+     * place in the frame.
+     *
+     * \param ledCount number of individual RGB LEDs.
+     * \param interleaved true to store the channels of each LED together.
+     * \param order channel order used when interleaved.
+     * \param frameStorage buffer used for the frame, or 0 to allocate it.
+     * \param tempStorage buffer used for the patterns, or 0 to allocate it.
+     */
+    void setupBuffers(LEDIndex ledCount,
+                      bool interleaved,
+                      EColorOrder order,
+                      uint8_t *frameStorage = 0,
+                      uint8_t *tempStorage = 0);
+
+    /*!
+     * Points the channel buffers and m_LED_count at a range of the strip.
+     *
+     * \param first index of the first LED of the range.
+     * \param count number of LEDs in the range.
+     */
+    void setupWindow(LEDIndex first, LEDIndex count);
+
+    /*!
+     * Saves the routine state of the selected segment into m_segments.
+     */
+    void storeSegment();
+
+    /*!
+     * Selects a segment by loading its routine state from m_segments, without saving
+     * the state of the segment that was selected.
+     */
+    void loadSegment(uint8_t index);
+
+    /*!
+     * Loads only the range, rotating view, transition and `isOn()` of a segment from
+     * m_segments, which is all that copying it out needs. The rest of the routine state,
+     * the palette included, stays that of the selected segment, so the view of the
+     * selected segment must be loaded again afterwards.
+     */
+    void loadView(uint8_t index);
+
+    /*!
+     * Resets the routine state of the selected segment to its defaults.
+     */
+    void resetSegment();
+
+    /*!
+     * Makes every segment apply the brightness again on its next frame, and draw the
+     * patterns it dimmed once again. Called when a setting shared by the segments changes.
+     */
+    void invalidateBrightness();
+
+    /*!
+     * Makes every segment that uses the custom colors set up its palette again. Must be
+     * called before the custom colors change.
+     */
+    void invalidateCustomPalette();
+
+    /*!
+     * Copies a range of LEDs of the strip without the layers, each segment through its
+     * own view of the buffers. The range must be within the strip.
+     *
+     * \param destination buffer that receives the LEDs, must hold at least `3 * count` bytes.
+     * \param order the channel order expected by the destination.
+     * \param first index of the first LED to copy.
+     * \param count number of LEDs to copy.
+     */
+    void copySegments(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count);
+
+    /*!
+     * Copies a range of LEDs of the selected segment, following its rotating view and `isOn()`.
+     *
+     * \param destination buffer that receives the LEDs, must hold at least `3 * count` bytes.
+     * \param order the channel order expected by the destination.
+     * \param first index of the first LED within the segment.
+     * \param count number of LEDs to copy, must not run past the end of the segment.
+     */
+    void copyView(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count);
+
+    /*!
+     * Draws the rotating view of every segment into the buffers as is, so the frame can be
+     * read directly.
+     */
+    void resolveFrame();
+
+    /*!
+     * Advances the xorshift random number generator and returns its new state. It takes
+     * three shifts and three xors, compared to the multiply and divide of `random()`.
+     */
+    uint32_t nextRandom()
+    {
+        uint32_t value = m_random_state;
+        value ^= value << 13;
+        value ^= value >> 17;
+        value ^= value << 5;
+        m_random_state = value;
+        return value;
+    }
+
+    /*!
+     * Retrieve the position of an LED in the channel buffers, following the rotating
+     * view if there is one.
+     */
+    size_t ledOffset(LEDIndex i)
+    {
+        if (m_rotation_length) {
+            if (i < m_LED_count - m_rotation_offset) {
+                i = i + m_rotation_offset;
+            } else {
+                i = i + m_rotation_offset - m_rotation_length;
+            }
+        }
+        return (size_t)i * m_stride;
+    }
 
     /*!
-     * Called before every function. Used to update the library state tracking
-     * and to reset any necessary variables when a state changes.
+     * Copies LEDs straight from the buffers, ignoring the rotating view and `isOn()`.
+     *
+     * \param destination buffer that receives the LEDs, must hold at least `3 * count` bytes.
+     * \param order the channel order expected by the destination.
+     * \param first position of the first LED in the buffers.
+     * \param count number of LEDs to copy, must not run past the last LED.
+     */
+    void copyBuffers(uint8_t *destination, EColorOrder order, LEDIndex first, LEDIndex count);
+
+    /*!
+     * Called by routines that use the rotating view before they draw. Returns true if the
+     * routine has to draw every LED, starting at the value of m_temp_buffer at m_temp_counter.
+     * Returns false if the pattern is already in the buffers.
+     */
+    bool startRotation();
+
+    /*!
+     * Called by routines that use the rotating view after they draw. Points the view at
+     * the current point of the pattern and moves that point forward one LED for the next frame.
+     */
+    void advanceRotation();
+
+    /*!
+     * Draws the current frame into the buffers as is and turns off the rotating view.
+     * Costs one pass over the LEDs.
+     */
+    void resolveRotation();
+
+    /*!
+     * Draws a range of LEDs of the pattern of singleWave or multiBars, starting at the value
+     * of m_temp_buffer at m_temp_counter. m_temp_counter is left at the value for the LED
+     * after the range, so consecutive ranges continue the pattern.
+     *
+     * \param first index of the first LED to draw.
+     * \param count number of LEDs to draw.
+     */
+    void drawPattern(LEDIndex first, LEDIndex count);
+
+    /*!
+     * Draws every LED of the pattern, starting at the value of m_temp_buffer at
+     * m_temp_counter, one chunk of RENDER_CHUNK_SIZE LEDs at a time.
+     *
+     * \param dim if true, each chunk is run through the brightness while it is still in
+     *        the cache, instead of in a second pass over the whole frame.
+     */
+    void drawFrame(bool dim);
+
+    /*!
+     * Adds a range of LEDs to the changed range. Must be called after drawing to the
+     * buffers with anything other than fillColorBuffers.
+     *
+     * \param first index of the first LED that was drawn, within the selected segment.
+     * \param last index of the last LED that was drawn, within the selected segment.
+     */
+    void markDirty(LEDIndex first, LEDIndex last);
+
+    /*!
+     * Adds a range of LEDs to the changed range when only how they are shown has changed,
+     * so the buffers still hold what was drawn.
+     *
+     * \param first index of the first LED that changed, within the selected segment.
+     * \param last index of the last LED that changed, within the selected segment.
+     */
+    void markShown(LEDIndex first, LEDIndex last);
+
+    /*!
+     * Retrieve how much of the old frame is shown by the selected segment's transition,
+     * from 256 when it starts down towards 0.
+     */
+    uint16_t transitionWeight();
+
+    // a routine's setup function, or its frame function, which takes the parameter given
+    // to runRoutine().
+    typedef void (ArduCor::*RoutineFunction)();
+    typedef void (ArduCor::*DrawFunction)(uint16_t parameter);
+    struct RoutineEntry
+    {
+        // called once when the routine starts, after the temps and palette are set up.
+        // 0 if the routine needs nothing else.
+        RoutineFunction setup;
+        // called on every frame.
+        DrawFunction    draw;
+    };
+    // the functions of each routine, indexed by ERoutine. Stored in program memory.
+    static const RoutineEntry s_routine_table[eRoutine_MAX];
+
+    /*!
+     * Called when the routine, its palette or its settings change. Resets the temp
+     * values, sets up the palette and then calls the routine's setup function.
      *
      * \param routine the routine that is about to be displayed
-     * \param the palette that will be used. For single color routines,
-     *        this value is ignored.
+     * \param palette the palette that will be used. Single color routines keep the current one.
+     * \param setup the routine's setup function from s_routine_table, or 0.
+     */
+    void startRoutine(uint8_t routine, EPalette palette, RoutineFunction setup);
+
+    /*!
+     * Sets up a routine if it, its palette or its settings changed, then draws it moved
+     * forward by m_steps. Starting a routine draws its first frame even if m_steps is 0.
+     *
+     * \return true if a frame was drawn.
+     */
+    bool drawRoutine(uint8_t routine, EPalette palette, uint16_t parameter);
+
+    /*!
+     * Retrieve the number of steps skipped before the frame being drawn, which the
+     * routines have to move forward without drawing them.
      */
-    void preProcess(ERoutine routine, EPalette palette);
+    uint16_t skippedSteps() { return m_steps - 1; }
 
     /*!
-     * Called by preprocessing if the the palette has changed. This sets up the
-     * m_temp_array and m_temp_size with the relevant data from the color palette.
+     * Draws the next frame of a custom routine, setting it up first if it, its palette or
+     * its settings changed.
+     *
+     * \param custom the routine's entry in m_custom_routines.
+     * \param routine the routine's value, eRoutine_MAX or more.
+     * \param palette the palette that will be used.
+     * \param parameter passed to the routine's draw function.
+     * \return true if a frame was drawn.
+     */
+    bool runCustomRoutine(const CustomRoutine& custom, uint8_t routine, EPalette palette, uint16_t parameter);
+
+    /*!
+     * Called when a routine starts or a segment is selected. This sets up the
+     * m_temp_array and m_temp_size with the relevant data from the color palette,
+     * unless they already hold it.
      *
      * \palette the new palette that is getting used by the routines.
      */
     void setupPalette(EPalette palette);
 
+    /*!
+     * Returns true if a copy of `palette` made from `cached` at the custom color
+     * `generation` still holds its colors.
+     */
+    bool isPaletteCurrent(EPalette cached, uint8_t generation, EPalette palette)
+    {
+        return (cached == palette)
+               && ((palette != eCustom) || (generation == m_custom_generation));
+    }
+
+    /*!
+     * Copies the colors of a palette into an array.
+     *
+     * \param palette the palette to copy.
+     * \param colors array that receives the colors, must hold 10 colors.
+     * \return the number of colors in the palette.
+     */
+    uint8_t copyPalette(EPalette palette, Color *colors);
+
+    // setup functions for s_routine_table.
+    void setupSingleWave();
+    void setupSingleSawtoothFade();
+    void setupGlimmerState();
+    void setupMultiFade();
+    void setupMultiBars();
+
+    // frame functions for s_routine_table. The parameter of each is described by runRoutine().
+    void drawSingleSolid(uint16_t);
+    void drawSingleBlink(uint16_t);
+    void drawSingleWave(uint16_t);
+    void drawSingleGlimmer(uint16_t percent);
+    void drawSingleFade(uint16_t isSine);
+    void drawSingleSawtoothFade(uint16_t fadeIn);
+    void drawMultiGlimmer(uint16_t percent);
+    void drawMultiFade(uint16_t);
+    void drawMultiRandomSolid(uint16_t);
+    void drawMultiRandomIndividual(uint16_t);
+    void drawMultiBars(uint16_t);
+
+    /*!
+     * Moves the counter of singleFade one step towards the end it is heading to, and turns
+     * it around when it gets there.
+     *
+     * \param step the amount the counter moves.
+     */
+    void stepFade(uint8_t step);
+
+    /*!
+     * Chooses the next two colors of multiFade once the fade between the last two is done.
+     */
+    void nextFadeColors();
+
     /*!
      * Sets two colors alternating in patches the size of barSize.
      * and moves them up in index on each frame.
@@ -443,7 +1495,7 @@ private:
      * \param startingValue the lowest possible value used by the moving buffer. Must
      *        be less than colorCount or otherwise it defaults to zero.
      */
-    void movingBufferSetup(uint16_t colorCount, byte groupSize, uint8_t startingValue = 0);
+    void movingBufferSetup(uint16_t colorCount, uint16_t groupSize, uint8_t startingValue = 0);
 
 
     /*!
@@ -459,9 +1511,34 @@ private:
      */
     void chooseRandomFromArray(Color *array, uint8_t max_index, boolean canRepeat);
 
+    /*!
+     * Rebuilds the glimmer thresholds if the percent has changed since the last glimmer frame.
+     *
+     * \param percent the percent given to the glimmer routine.
+     */
+    void setupGlimmer(uint8_t percent);
+
+    /*!
+     * Retrieve how many LEDs to skip before the next LED that gets a glimmer effect. Each
+     * LED glimmers independently, so this costs about one random number per glimmering LED
+     * instead of one per LED.
+     */
+    uint32_t glimmerSkip();
+
+    /*!
+     * Applies one glimmer effect to randomly chosen LEDs, using the percent given to
+     * setupGlimmer().
+     *
+     * \param changeColor if true, the chosen LEDs get a random color from m_temp_array. If
+     *        false, the chosen LEDs are dimmed by a random level.
+     */
+    void glimmerPass(bool changeColor);
+
     /*!
      * Uses memset to change every value in the r_buffer to r, the g_buffer to g, and the b_buffer
-     * to b. All previous colors in the buffers will be overwritten by this function call.
+     * to b. All previous colors in the buffers will be overwritten by this function call. If
+     * the buffers already hold only this color, the frame stays unchanged. If they hold it
+     * dimmed by `applyBrightness()`, it is written again without counting as a change.
      *
      * \param r the new value for all red LEDs.
      * \param g the new value for all green LEDs.
@@ -469,6 +1546,12 @@ private:
      */
     void fillColorBuffers(uint8_t r, uint8_t g, uint8_t b);
 
+    /*!
+     * Writes one color to every LED of the selected segment, without marking the frame as
+     * changed or keeping the color for `fillColorBuffers()`.
+     */
+    void writeFill(uint8_t r, uint8_t g, uint8_t b);
+
     /*!
      * Sets the size of bars in routines that use them. Bars are groups of LEDs that
      * all display the same color. The routines SingleWave, MultiBarsSolid, and
@@ -476,7 +1559,92 @@ private:
      *
      * \barSize a number greater than 0 and less than the number of LEDs being used.
      */
-    void barSize(uint8_t barSize);
+    void barSize(uint16_t barSize);
+
+    /*!
+     * Rebuilds m_brightness_table from the brightness level and gamma setting.
+     */
+    void buildBrightnessTable();
+
+    /*!
+     * Maps every LED in the buffers through m_brightness_table and the white balance.
+     */
+    void dimBuffers();
+
+    /*!
+     * Maps a range of LEDs through m_brightness_table and the white balance.
+     *
+     * \param first index of the first LED of the range.
+     * \param count number of LEDs in the range.
+     */
+    void dimRange(LEDIndex first, LEDIndex count);
+
+    /*!
+     * Returns true if the brightness, gamma and white balance leave every value unchanged.
+     */
+    bool isFullBrightness()
+    {
+        return (m_bright_level == 100)
+                && !m_gamma_enabled
+                && (m_white_balance.red == 255)
+                && (m_white_balance.green == 255)
+                && (m_white_balance.blue == 255);
+    }
+};
+
+/*!
+ * \brief The buffers of a StaticArduCor. They are a base class of StaticArduCor so that
+ *        they exist before the ArduCor base class is constructed.
+ */
+template <ArduCor::LEDIndex N>
+struct StaticArduCorBuffers
+{
+    static_assert(N > 0, "StaticArduCor needs at least one LED");
+
+    // three bytes per LED. The size is computed in 32 bits, so a strip that can't fit in
+    // memory fails to compile instead of wrapping around.
+    uint8_t frameStorage[(uint32_t)N * 3];
+    // one value per LED, but room for at least one value per palette color.
+    uint8_t tempStorage[(N < 10) ? 10 : N];
+};
+
+/*!
+ * \brief An ArduCor with its number of LEDs fixed at compile time and its buffers stored
+ *        in the object itself instead of allocated on the heap.
+ *
+ * \details Declared as a global, its buffers are counted in the RAM usage reported when a
+ * sketch is compiled, so a strip that is too long for the board fails at link time instead
+ * of at boot. It behaves exactly like an ArduCor of the same size:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * StaticArduCor<LED_COUNT> routines(ArduCor::eOrderGRB);
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Only the storage is sized by N. The routines are compiled once and shared with every
+ * ArduCor, so their loops still run to the LED count of the selected segment at run time,
+ * which is shorter than N once the strip is split into segments.
+ *
+ * The frame and the temp buffer are the only buffers stored in the object. The features
+ * that allocate on first use still do, as listed for `ArduCor(LEDIndex)`: the segments,
+ * the copy of the frame for a transition, and the palette gradient. Like an ArduCor, it
+ * can't be copied.
+ */
+template <ArduCor::LEDIndex N>
+class StaticArduCor : private StaticArduCorBuffers<N>, public ArduCor
+{
+public:
+
+    /*!
+     * Stores each channel in its own plane, like `ArduCor(ledCount)`.
+     */
+    StaticArduCor()
+        : ArduCor(N, false, eOrderRGB, this->frameStorage, this->tempStorage) {}
+
+    /*!
+     * Stores the LEDs interleaved in the given channel order, like `ArduCor(ledCount, order)`.
+     */
+    StaticArduCor(EColorOrder order)
+        : ArduCor(N, true, order, this->frameStorage, this->tempStorage) {}
 };
 
 #endif //ArduCor_h
@@ -0,0 +1,108 @@
+/*!
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ */
+
+#include "ArduCorParser.h"
+
+// Based on this guide http://excamera.com/sphinx/article-crc.html
+// 8-bit CRC is too little, 32-bit is a bit overkill but this method
+// is really elegant and uses very little PROGMEM
+const PROGMEM uint32_t crcTable[16] =
+{
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t
+ArduCorParser::crcUpdate(uint32_t crc, uint8_t data)
+{
+    uint8_t tableIndex;
+    tableIndex = crc ^ (data >> (0 * 4));
+    crc = pgm_read_dword_near(crcTable + (tableIndex & 0x0f)) ^ (crc >> 4);
+    tableIndex = crc ^ (data >> (1 * 4));
+    crc = pgm_read_dword_near(crcTable + (tableIndex & 0x0f)) ^ (crc >> 4);
+    return crc;
+}
+
+uint32_t
+ArduCorParser::crc(const char* text)
+{
+    uint32_t crc = ~(uint32_t)0;
+    while (*text != 0) {
+        crc = crcUpdate(crc, *text++);
+    }
+    return ~crc;
+}
+
+bool
+ArduCorParser::checkPacket(char* packet, bool useCRC)
+{
+    uint32_t computedCRC = ~(uint32_t)0;
+    uint32_t givenCRC = 0;
+    char* hash = 0;
+    // the CRC ends at the first character after it that isn't a digit, anything after that
+    // is ignored
+    bool crcEnded = false;
+    for (char* c = packet; *c != 0; ++c) {
+        if (*c == '#') {
+            // # is only used in CRCs, and a valid packet can only have one
+            if (!useCRC || hash) {
+                return false;
+            }
+            hash = c;
+        } else if (!isPacketCharacter(*c)) {
+            return false;
+        } else if (!hash) {
+            computedCRC = crcUpdate(computedCRC, *c);
+        } else if ((*c < '0') || (*c > '9')) {
+            crcEnded = true;
+        } else if (!crcEnded) {
+            givenCRC = givenCRC * 10 + (*c - '0');
+        }
+    }
+    if (!useCRC) {
+        return true;
+    }
+    if (!hash) {
+        return false;
+    }
+    *hash = 0;
+    return (givenCRC == (uint32_t)~computedCRC);
+}
+
+const char*
+ArduCorParser::parseMessage(const char* message, int* values, uint8_t maxValues, uint8_t* count)
+{
+    uint8_t size = 0;
+    bool overflow = false;
+    const char* c = message;
+    while ((*c != 0) && (*c != '&')) {
+        if (*c == ',') {
+            ++c;
+            continue;
+        }
+        bool negative = (*c == '-');
+        if (negative) {
+            ++c;
+        }
+        unsigned int value = 0;
+        while ((*c >= '0') && (*c <= '9')) {
+            value = value * 10 + (*c++ - '0');
+        }
+        // like atoi(), a value ends at its first character that isn't a digit
+        while ((*c != 0) && (*c != ',') && (*c != '&')) {
+            ++c;
+        }
+        if (size < maxValues) {
+            values[size++] = negative ? -(int)value : (int)value;
+        } else {
+            overflow = true;
+        }
+    }
+    *count = overflow ? 0 : size;
+    return c;
+}
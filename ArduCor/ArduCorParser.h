@@ -0,0 +1,96 @@
+#ifndef ArduCorParser_h
+#define ArduCorParser_h
+
+#include "Arduino.h"
+
+/*!
+ * \file ArduCorParser.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * \brief Reads the ASCII packets described in ArduCorProtocols.h without copying them.
+ *
+ * \details A packet such as `1,0,10,3,150&3,0,50&#3062380687&` is made of messages
+ * separated by `&`, each a list of integers separated by `,`, with an optional CRC after
+ * the `#`. `checkPacket()` checks the whole packet in one pass, then `parseMessage()`
+ * reads one message at a time where it is, so the span of a message can be echoed
+ * straight from the packet:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * if (ArduCorParser::checkPacket(packet, USE_CRC)) {
+ *     const char* message = packet;
+ *     while (*message != 0) {
+ *         const char* end = ArduCorParser::parseMessage(message, values, MAX_VALUES, &count);
+ *         // use the count values, the message is the characters from message to end
+ *         message = ArduCorParser::nextMessage(end);
+ *     }
+ * }
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ */
+class ArduCorParser
+{
+public:
+
+    /*!
+     * Adds a byte to a CRC-32. A CRC starts at `~0`, and is inverted once every byte has
+     * been added.
+     *
+     * \param crc the CRC of the bytes before this one.
+     * \param data the byte to add.
+     * \return the CRC including the byte.
+     */
+    static uint32_t crcUpdate(uint32_t crc, uint8_t data);
+
+    /*!
+     * Computes the CRC-32 of a string.
+     *
+     * \param text the string, up to its terminating null.
+     * \return the CRC of the string.
+     */
+    static uint32_t crc(const char* text);
+
+    /*!
+     * Checks if a character can be part of the messages of an ASCII packet.
+     *
+     * \param c the character.
+     * \return true for digits, `,`, `&`, and `-`.
+     */
+    static bool isPacketCharacter(char c) { return ((c >= '0') && (c <= '9')) || (c == ',') || (c == '&') || (c == '-'); }
+
+    /*!
+     * Checks the characters of an ASCII packet, and its CRC, in a single pass over the
+     * packet. The CRC is cut off by replacing its `#` with a null, so the packet ends
+     * after its last message.
+     *
+     * \param packet the packet, up to its terminating null.
+     * \param useCRC true if the packet must end with the CRC of its messages, false if it
+     *        must not have one.
+     * \return true if the packet can be parsed, false otherwise.
+     */
+    static bool checkPacket(char* packet, bool useCRC);
+
+    /*!
+     * Reads the integers of the message at the start of a checked packet without changing
+     * the packet. Empty values are skipped, the same way `strtok()` skips them.
+     *
+     * \param message the start of the message.
+     * \param values receives the integers of the message.
+     * \param maxValues the number of integers values can hold.
+     * \param count receives the number of integers, or 0 if the message has more than
+     *        maxValues.
+     * \return the end of the message, at its `&` or at the end of the packet.
+     */
+    static const char* parseMessage(const char* message, int* values, uint8_t maxValues, uint8_t* count);
+
+    /*!
+     * Finds the message after the end of a message.
+     *
+     * \param end the end returned by `parseMessage()`.
+     * \return the start of the next message, or the end of the packet.
+     */
+    static const char* nextMessage(const char* end) { return (*end == '&') ? end + 1 : end; }
+};
+
+#endif
@@ -14,7 +14,7 @@
  * between the two projects seem mixed up, check that the version of the Corluma App you are using
  * matches the version of the your ArduCor library.
  *
- * Protocol Version: 3.3
+ * Protocol Version: 3.5
  *
  */
 
@@ -249,5 +249,85 @@ enum EPacketHeader
    * <i>Sends back a packet that contains the size of the custom array and all of the colors in it. </i>
    */
   eCustomArrayUpdateRequest,
+  /*!
+   * <b>8</b><br>
+   * <i>Draws colors streamed for a range of LEDs in place of the routine. Takes the first
+   * LED as two values, least significant first, an ERealtimeEncoding, and the colors. Each
+   * value is 0-255. The routine comes back once no frame has arrived for the realtime
+   * timeout of the hardware. An ASCII message holds at most 15 values with its header,
+   * which leaves 10 for the colors, or 3 LEDs of eRealtimeRaw, so the frames are meant to
+   * be sent in binary packets.</i>
+   */
+  eRealtimeFrame,
   ePacketHeader_MAX //total number of Packet Headers
 };
+
+
+/*!
+ * \enum ERealtimeEncoding How the colors of an eRealtimeFrame message are packed, so the
+ *       size of a frame follows how much of the image changed.
+ */
+enum ERealtimeEncoding
+{
+  /*!
+   * <b>0</b><br>
+   * <i>Red, green and blue of each LED from the first LED on.</i>
+   */
+  eRealtimeRaw,
+  /*!
+   * <b>1</b><br>
+   * <i>Runs of LEDs with the same color, each a number of LEDs followed by its red, green
+   * and blue.</i>
+   */
+  eRealtimeRun,
+  /*!
+   * <b>2</b><br>
+   * <i>Only the LEDs that changed since the last frame. Each span is a number of LEDs
+   * that keep their color, a number of LEDs that change, and the red, green and blue of
+   * each LED that changes.</i>
+   */
+  eRealtimeDelta,
+  eRealtimeEncoding_MAX //total number of encodings
+};
+
+
+/*!
+ * \enum ECapability Flags sent in the capabilities field of the discovery packet, which
+ *       tell an application what the hardware supports.
+ */
+enum ECapability
+{
+  /*!
+   * <b>1</b><br>
+   * <i>The hardware is a Raspberry Pi instead of an Arduino.</i>
+   */
+  eCapabilityRaspberryPi = 1,
+  /*!
+   * <b>2</b><br>
+   * <i>The hardware accepts binary packets as well as ASCII packets.</i>
+   */
+  eCapabilityBinaryPackets = 2
+};
+
+
+/*!
+ * Binary packets carry the same messages as the ASCII packets in fewer bytes, for slow links
+ * such as serial. They are only sent to hardware that sets `eCapabilityBinaryPackets`.
+ *
+ * A packet is `BINARY_PACKET_START`, the length of its messages, the messages, and the CRC-32
+ * of the length and the messages, least significant byte first. The CRC is always sent.
+ *
+ * Each message is its EPacketHeader, the number of values after the header, and the values,
+ * in the same order as the values of the ASCII message. Each value is one byte, unless
+ * `BINARY_WIDE_VALUES` is added to the header, in which case every value of the message is
+ * two bytes, least significant byte first. A mode change to eMultiBars on hardware index 1
+ * with palette 3, speed 150 and bars of 4 LEDs is:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * 0xA5  0x07  0x01 0x05 0x01 0x0A 0x03 0x96 0x04  crc crc crc crc
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ * The hardware echoes the messages that it accepts in a binary packet.
+ */
+const uint8_t BINARY_PACKET_START = 0xA5;
+const uint8_t BINARY_WIDE_VALUES  = 0x80;
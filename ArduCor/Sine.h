@@ -0,0 +1,49 @@
+/*!
+ * \file Sine.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * One cycle of the curve used by the sine fade, stored in program memory. Entry i holds
+ * (sin(6.28 * i / 256 - 1.67) + 1) / 2 as a 16 bit fraction, where 65535 is full brightness.
+ * The last entry repeats the start of the next cycle so that the value between any two
+ * entries can be interpolated without wrapping. This keeps floating point math and `sin()`
+ * out of the fade routines.
+ *
+ */
+
+#include <avr/pgmspace.h>
+
+const PROGMEM uint16_t sineCurve[257] = {   161,    91,    41,    11,     0,     9,    38,    86,
+                                            154,   242,   349,   476,   622,   788,   972,  1176,
+                                           1399,  1641,  1902,  2181,  2478,  2794,  3128,  3479,
+                                           3849,  4235,  4639,  5060,  5497,  5951,  6421,  6907,
+                                           7408,  7925,  8456,  9003,  9563, 10138, 10726, 11327,
+                                          11941, 12568, 13207, 13858, 14520, 15193, 15877, 16570,
+                                          17274, 17987, 18709, 19439, 20177, 20923, 21676, 22436,
+                                          23201, 23973, 24750, 25532, 26318, 27108, 27901, 28697,
+                                          29496, 30297, 31099, 31902, 32706, 33510, 34313, 35116,
+                                          35917, 36716, 37512, 38306, 39097, 39883, 40666, 41443,
+                                          42216, 42983, 43743, 44497, 45244, 45984, 46715, 47438,
+                                          48153, 48858, 49553, 50238, 50913, 51577, 52229, 52870,
+                                          53499, 54115, 54718, 55308, 55885, 56448, 56996, 57530,
+                                          58049, 58552, 59041, 59513, 59969, 60409, 60833, 61239,
+                                          61628, 62000, 62355, 62691, 63010, 63310, 63592, 63855,
+                                          64100, 64326, 64533, 64720, 64889, 65038, 65168, 65278,
+                                          65369, 65440, 65491, 65523, 65535, 65527, 65500, 65453,
+                                          65386, 65299, 65193, 65068, 64923, 64759, 64575, 64372,
+                                          64151, 63910, 63651, 63373, 63077, 62762, 62429, 62079,
+                                          61711, 61325, 60923, 60503, 60067, 59614, 59145, 58660,
+                                          58160, 57644, 57114, 56568, 56009, 55435, 54848, 54247,
+                                          53634, 53008, 52370, 51720, 51058, 50386, 49703, 49010,
+                                          48307, 47595, 46873, 46144, 45406, 44661, 43908, 43149,
+                                          42383, 41612, 40836, 40054, 39268, 38479, 37685, 36889,
+                                          36091, 35290, 34488, 33685, 32881, 32077, 31274, 30472,
+                                          29670, 28871, 28074, 27280, 26490, 25703, 24920, 24142,
+                                          23369, 22602, 21841, 21086, 20339, 19599, 18867, 18143,
+                                          17429, 16723, 16027, 15341, 14666, 14001, 13348, 12706,
+                                          12077, 11460, 10856, 10265,  9687,  9124,  8574,  8039,
+                                           7519,  7015,  6526,  6052,  5595,  5154,  4729,  4322,
+                                           3931,  3558,  3203,  2865,  2545,  2244,  1961,  1696,
+                                           1450,  1223,  1015,   826,   657,   506,   375,   264,
+                                            172 };
@@ -0,0 +1,150 @@
+/*!
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ */
+
+#include "RenderScheduler.h"
+
+RenderScheduler::RenderScheduler(unsigned threadCount)
+    : m_queues(threadCount ? threadCount
+                           : (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1)),
+      m_zones(0),
+      m_render(0),
+      m_frame(0),
+      m_busy(0),
+      m_stopping(false)
+{
+    for (unsigned i = 0; i < m_queues.size(); ++i) {
+        m_queues[i].first = 0;
+        m_queues[i].last = 0;
+    }
+    // the caller draws with the first queue
+    for (unsigned i = 1; i < m_queues.size(); ++i) {
+        m_threads.push_back(std::thread(&RenderScheduler::workerLoop, this, i));
+    }
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_frame_mutex);
+        m_stopping = true;
+    }
+    m_frame_started.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i) {
+        m_threads[i].join();
+    }
+}
+
+void
+RenderScheduler::renderFrame(ArduCor* const* zones, size_t count, const RenderFunction& render)
+{
+    // every thread is waiting for the frame, so the queues can be filled without them
+    unsigned threads = threadCount();
+    for (unsigned i = 0; i < threads; ++i) {
+        std::lock_guard<std::mutex> lock(m_queues[i].mutex);
+        m_queues[i].first = count * i / threads;
+        m_queues[i].last = count * (i + 1) / threads;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_frame_mutex);
+        m_zones = zones;
+        m_render = &render;
+        m_busy = threads - 1;
+        ++m_frame;
+    }
+    m_frame_started.notify_all();
+
+    drawQueue(0);
+
+    // the frame barrier, nothing is returned until every object has been drawn
+    std::unique_lock<std::mutex> lock(m_frame_mutex);
+    while (m_busy != 0) {
+        m_frame_finished.wait(lock);
+    }
+}
+
+void
+RenderScheduler::workerLoop(unsigned index)
+{
+    uint64_t frame = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_frame_mutex);
+            while (!m_stopping && (m_frame == frame)) {
+                m_frame_started.wait(lock);
+            }
+            if (m_stopping) {
+                return;
+            }
+            frame = m_frame;
+        }
+        drawQueue(index);
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(m_frame_mutex);
+            last = (--m_busy == 0);
+        }
+        if (last) {
+            m_frame_finished.notify_one();
+        }
+    }
+}
+
+void
+RenderScheduler::drawQueue(unsigned index)
+{
+    size_t zone;
+    while (true) {
+        if (!takeZone(index, &zone)) {
+            // what was stolen may be stolen again before it is taken, so this checks again
+            if (!stealZones(index)) {
+                return;
+            }
+            continue;
+        }
+        (*m_render)(*m_zones[zone], zone);
+    }
+}
+
+bool
+RenderScheduler::takeZone(unsigned index, size_t *zone)
+{
+    WorkQueue& queue = m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.first == queue.last) {
+        return false;
+    }
+    *zone = queue.first++;
+    return true;
+}
+
+bool
+RenderScheduler::stealZones(unsigned index)
+{
+    // start with the next thread, so the threads out of work don't all pick the same one
+    unsigned threads = threadCount();
+    for (unsigned i = 1; i < threads; ++i) {
+        WorkQueue& victim = m_queues[(index + i) % threads];
+        size_t first;
+        size_t last;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            size_t left = victim.last - victim.first;
+            if (left == 0) {
+                continue;
+            }
+            // take the back half, rounded up so the last object can be stolen too
+            last = victim.last;
+            first = last - (left + 1) / 2;
+            victim.last = first;
+        }
+        WorkQueue& queue = m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.first = first;
+        queue.last = last;
+        return true;
+    }
+    return false;
+}
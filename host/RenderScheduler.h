@@ -0,0 +1,131 @@
+#ifndef RenderScheduler_h
+#define RenderScheduler_h
+
+/*!
+ * \file RenderScheduler.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Renders the frames of many ArduCor objects at once on the host, such as a gateway
+ * that drives one object for each fixture. Each ArduCor keeps all of its state in its
+ * members, so different objects can be drawn on different threads without locks.
+ *
+ */
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "ArduCor.h"
+
+class RenderScheduler
+{
+public:
+    /*!
+     * Draws the frame of one object, such as running its routine and then calling
+     * `applyBrightness()` and `copyFrame()`. It is called from the scheduler's threads,
+     * so it may only touch the object it is given and data that no other call writes to.
+     * It must not throw.
+     *
+     * \param routines the object to draw.
+     * \param index the object's index in the array given to `renderFrame()`.
+     */
+    typedef std::function<void(ArduCor& routines, size_t index)> RenderFunction;
+
+    /*!
+     * Starts the threads of the scheduler. The thread that calls `renderFrame()` draws
+     * objects as well, so `threadCount - 1` threads are started.
+     *
+     * \param threadCount number of threads that draw, 0 uses one for each core.
+     */
+    explicit RenderScheduler(unsigned threadCount = 0);
+
+    /*!
+     * Stops the threads. Must not be called while `renderFrame()` is running.
+     */
+    ~RenderScheduler();
+
+    /*!
+     * Retrieve the number of threads that draw, including the one that calls `renderFrame()`.
+     */
+    unsigned threadCount() const { return (unsigned)m_queues.size(); }
+
+    /*!
+     * Draws a frame of every object and returns once all of them are done, so the frames
+     * can be sent out together. The objects are split evenly between the threads, and a
+     * thread that finishes its share early takes half of what another thread has left.
+     *
+     * \param zones the objects to draw. Each one must appear only once.
+     * \param count number of objects in zones.
+     * \param render draws the frame of one object.
+     */
+    void renderFrame(ArduCor* const* zones, size_t count, const RenderFunction& render);
+
+private:
+
+    // the objects a thread has left to draw in the current frame. The owner takes them
+    // from the front, other threads steal from the back.
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        size_t first;
+        size_t last;
+        // keeps each queue on its own cache line, so the threads don't slow each other down.
+        char padding[64];
+    };
+    std::vector<WorkQueue> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // the frame being drawn.
+    ArduCor* const* m_zones;
+    const RenderFunction *m_render;
+
+    // wakes the threads when a frame starts and the caller when they are done with it.
+    std::mutex m_frame_mutex;
+    std::condition_variable m_frame_started;
+    std::condition_variable m_frame_finished;
+    // counts the frames, so a thread can tell a new frame from a spurious wake up.
+    uint64_t m_frame;
+    // number of started threads still drawing the frame.
+    unsigned m_busy;
+    bool     m_stopping;
+
+    /*!
+     * Waits for each frame and draws its share of it, until the scheduler is destroyed.
+     *
+     * \param index the thread's queue.
+     */
+    void workerLoop(unsigned index);
+
+    /*!
+     * Draws objects from a thread's queue, and from the other queues once it is empty,
+     * until every object of the frame has been taken.
+     *
+     * \param index the thread's queue.
+     */
+    void drawQueue(unsigned index);
+
+    /*!
+     * Takes the next object from the front of a thread's queue.
+     *
+     * \param index the thread's queue.
+     * \param zone receives the index of the object.
+     * \return true if an object was taken, false if the queue is empty.
+     */
+    bool takeZone(unsigned index, size_t *zone);
+
+    /*!
+     * Moves half of the objects left in another thread's queue into a thread's queue.
+     *
+     * \param index the queue of the thread that is out of work.
+     * \return true if anything was stolen, false if every queue is empty.
+     */
+    bool stealZones(unsigned index);
+};
+
+#endif
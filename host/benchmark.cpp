@@ -0,0 +1,319 @@
+/*!
+ * \file benchmark.cpp
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Times every public ArduCor routine on the host at a range of LED counts and
+ * reports the cost per frame and per LED. Run it before and after touching a
+ * routine so that regressions in the render loops show up before they reach a strip.
+ * `--leds` measures only the given LED count, which doesn't have to be one of the range.
+ *
+ * Usage: `arducor_benchmark [--quick] [--routine <name>] [--leds <count>]`
+ *
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "ArduCor.h"
+
+//================================================================================
+// Routines
+//================================================================================
+
+// color used by the single color routines.
+const uint8_t R = 0;
+const uint8_t G = 127;
+const uint8_t B = 255;
+
+const uint8_t GLIMMER_PERCENT = 10;
+const uint8_t BAR_SIZE        = 4;
+
+struct Benchmark
+{
+    const char* name;
+    void (*render)(ArduCor& routines);
+    // if true, the LEDs are stored interleaved in GRB order.
+    bool interleaved;
+    // optional, called before and after the measurement for what lasts across frames.
+    void (*setup)(ArduCor& routines);
+    void (*finish)(ArduCor& routines);
+};
+
+// stands in for the buffer of an LED driver such as Adafruit_NeoPixel. It is sized for
+// the longest strip that gets measured.
+uint8_t *driverBuffer;
+
+void singleSolid(ArduCor& routines)           { routines.singleSolid(R, G, B); }
+void singleBlink(ArduCor& routines)           { routines.singleBlink(R, G, B); }
+void singleWave(ArduCor& routines)            { routines.singleWave(R, G, B); }
+void singleGlimmer(ArduCor& routines)         { routines.singleGlimmer(R, G, B, GLIMMER_PERCENT); }
+void singleFadeLinear(ArduCor& routines)      { routines.singleFade(R, G, B, false); }
+void singleFadeSine(ArduCor& routines)        { routines.singleFade(R, G, B, true); }
+void singleSawtoothFadeIn(ArduCor& routines)  { routines.singleSawtoothFade(R, G, B, true); }
+void singleSawtoothFadeOut(ArduCor& routines) { routines.singleSawtoothFade(R, G, B, false); }
+void multiGlimmer(ArduCor& routines)          { routines.multiGlimmer(eFire, GLIMMER_PERCENT); }
+void multiFade(ArduCor& routines)             { routines.multiFade(eSevenColor); }
+void multiRandomSolid(ArduCor& routines)      { routines.multiRandomSolid(eFire); }
+void multiRandomIndividual(ArduCor& routines) { routines.multiRandomIndividual(eFire); }
+void multiBars(ArduCor& routines)             { routines.multiBars(eSevenColor, BAR_SIZE); }
+
+void applyBrightness(ArduCor& routines)
+{
+    // changing the brightness forces the post-process to run on every frame,
+    // which is what the multi color routines do.
+    routines.brightness(50);
+    routines.applyBrightness();
+}
+
+void applyBrightnessCorrected(ArduCor& routines)
+{
+    routines.gammaCorrection(true);
+    routines.whiteBalance(255, 200, 180);
+    routines.brightness(50);
+    routines.applyBrightness();
+}
+
+void exportPerLED(ArduCor& routines)
+{
+    // the way the samples used to fill a NeoPixel buffer, one getter per channel.
+    for (ArduCor::LEDIndex i = 0; i < routines.frameBufferSize() / 3; ++i) {
+        driverBuffer[i * 3]     = routines.green(i);
+        driverBuffer[i * 3 + 1] = routines.red(i);
+        driverBuffer[i * 3 + 2] = routines.blue(i);
+    }
+}
+
+void exportInterleaved(ArduCor& routines)
+{
+    memcpy(driverBuffer, routines.frameBuffer(), routines.frameBufferSize());
+}
+
+void copyFrame(ArduCor& routines)
+{
+    routines.copyFrame(driverBuffer, ArduCor::eOrderGRB, 0, routines.frameBufferSize() / 3);
+}
+
+void multiBarsCopyFrame(ArduCor& routines)
+{
+    // a full frame as the samples draw it. multiBars only moves its view, so most of
+    // the cost is the two part copy into the driver buffer.
+    multiBars(routines);
+    routines.applyBrightness();
+    copyFrame(routines);
+}
+
+void segments(ArduCor& routines)
+{
+    // a strip split into eight zones that each run their own routine, drawn into one
+    // frame and copied into the driver buffer at once.
+    if ((routines.segmentCount() == 1) && (routines.frameBufferSize() >= 8 * 3)) {
+        routines.setupSegments(8);
+    }
+    for (uint8_t i = 0; i < routines.segmentCount(); ++i) {
+        routines.selectSegment(i);
+        if (i % 2) {
+            multiBars(routines);
+        } else {
+            singleFadeSine(routines);
+        }
+        routines.applyBrightness();
+    }
+    copyFrame(routines);
+}
+
+void routineSwitch(ArduCor& routines)
+{
+    // a controller switching modes quickly, so every frame sets up a routine with the
+    // same palette as the last one.
+    static bool fade = false;
+    fade = !fade;
+    if (fade) {
+        routines.multiFade(eSevenColor);
+    } else {
+        routines.multiRandomSolid(eSevenColor);
+    }
+}
+
+// a glimmer blended over bars, so each frame draws two routines and blends them while
+// copying into the driver buffer. The overlay lasts for the measurement, like the layers
+// in a sketch.
+ArduCor::Layer overlay = { 0, ArduCor::eBlendAlpha, 77 };
+
+void setupLayers(ArduCor& routines)
+{
+    overlay.routines = new ArduCor(routines.frameBufferSize() / 3, ArduCor::eOrderGRB);
+    routines.setLayers(&overlay, 1);
+}
+
+void finishLayers(ArduCor& routines)
+{
+    routines.setLayers(0, 0);
+    delete overlay.routines;
+    overlay.routines = 0;
+}
+
+void layers(ArduCor& routines)
+{
+    multiBars(routines);
+    routines.applyBrightness();
+    overlay.routines->singleGlimmer(R, G, B, GLIMMER_PERCENT);
+    overlay.routines->applyBrightness();
+    copyFrame(routines);
+}
+
+const Benchmark benchmarks[] = {
+    { "singleSolid",              singleSolid,              false, NULL,        NULL },
+    { "singleBlink",              singleBlink,              false, NULL,        NULL },
+    { "singleWave",               singleWave,               false, NULL,        NULL },
+    { "singleGlimmer",            singleGlimmer,            false, NULL,        NULL },
+    { "singleFadeLinear",         singleFadeLinear,         false, NULL,        NULL },
+    { "singleFadeSine",           singleFadeSine,           false, NULL,        NULL },
+    { "singleSawtoothFadeIn",     singleSawtoothFadeIn,     false, NULL,        NULL },
+    { "singleSawtoothFadeOut",    singleSawtoothFadeOut,    false, NULL,        NULL },
+    { "multiGlimmer",             multiGlimmer,             false, NULL,        NULL },
+    { "multiFade",                multiFade,                false, NULL,        NULL },
+    { "multiRandomSolid",         multiRandomSolid,         false, NULL,        NULL },
+    { "multiRandomIndividual",    multiRandomIndividual,    false, NULL,        NULL },
+    { "multiBars",                multiBars,                false, NULL,        NULL },
+    { "applyBrightness",          applyBrightness,          false, NULL,        NULL },
+    { "applyBrightnessCorrected", applyBrightnessCorrected, false, NULL,        NULL },
+    { "multiBarsInterleaved",     multiBars,                true,  NULL,        NULL },
+    { "exportPerLED",             exportPerLED,             false, NULL,        NULL },
+    { "exportInterleaved",        exportInterleaved,        true,  NULL,        NULL },
+    { "copyFramePlanar",          copyFrame,                false, NULL,        NULL },
+    { "copyFrameInterleaved",     copyFrame,                true,  NULL,        NULL },
+    { "multiBarsCopyFrame",       multiBarsCopyFrame,       true,  NULL,        NULL },
+    { "segments",                 segments,                 true,  NULL,        NULL },
+    { "routineSwitch",            routineSwitch,            false, NULL,        NULL },
+    { "layers",                   layers,                   true,  setupLayers, finishLayers },
+};
+
+#ifdef ARDUCOR_LARGE_STRIP
+const ArduCor::LEDIndex ledCounts[] = { 1, 8, 64, 120, 512, 4096, 16384, 65535, 262144, 1048576 };
+#else
+const ArduCor::LEDIndex ledCounts[] = { 1, 8, 64, 120, 512, 4096, 16384, 65535 };
+#endif
+
+//================================================================================
+// Timing
+//================================================================================
+
+typedef std::chrono::steady_clock Clock;
+
+/*!
+ * Renders frames until `budgetNs` has passed, then returns the average cost of a frame.
+ */
+double timeFrames(const Benchmark& benchmark, ArduCor::LEDIndex ledCount, double budgetNs, unsigned long* frameCount)
+{
+    // the object can't be copied, so the constructor is picked with new
+    ArduCor *routines = benchmark.interleaved ? new ArduCor(ledCount, ArduCor::eOrderGRB) : new ArduCor(ledCount);
+    routines->seedRandom(1);
+    if (benchmark.setup) {
+        benchmark.setup(*routines);
+    }
+
+    // warm up the routine so that its setup isn't part of the measurement.
+    for (int i = 0; i < 4; ++i) {
+        benchmark.render(*routines);
+    }
+
+    unsigned long frames = 0;
+    unsigned long batch = 1;
+    double elapsedNs = 0;
+    Clock::time_point start = Clock::now();
+    while (elapsedNs < budgetNs) {
+        for (unsigned long i = 0; i < batch; ++i) {
+            benchmark.render(*routines);
+        }
+        frames += batch;
+        // grow the batch so that reading the clock doesn't dominate tiny frames.
+        if (batch < 1024) {
+            batch *= 2;
+        }
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+    if (benchmark.finish) {
+        benchmark.finish(*routines);
+    }
+    delete routines;
+    *frameCount = frames;
+    return elapsedNs / frames;
+}
+
+//================================================================================
+// Main
+//================================================================================
+
+void printUsage(const char* program)
+{
+    printf("usage: %s [--quick] [--routine <name>] [--leds <count>]\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    double budgetNs = 50e6;
+    const char* routineFilter = NULL;
+    long ledFilter = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            budgetNs = 2e6;
+        } else if ((strcmp(argv[i], "--routine") == 0) && (i + 1 < argc)) {
+            routineFilter = argv[++i];
+        } else if ((strcmp(argv[i], "--leds") == 0) && (i + 1 < argc)) {
+            ledFilter = atol(argv[++i]);
+            if (ledFilter <= 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // the counts are measured in increasing order, so the last one is the longest strip
+    const ArduCor::LEDIndex* counts = ledCounts;
+    size_t ledCountSize = sizeof(ledCounts) / sizeof(ArduCor::LEDIndex);
+    ArduCor::LEDIndex ledCount = (ArduCor::LEDIndex)ledFilter;
+    if (ledFilter >= 0) {
+        // a count that doesn't fit in an LEDIndex would be measured as a different one
+        if (ledCount != ledFilter) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        counts = &ledCount;
+        ledCountSize = 1;
+    }
+    bool routineFound = (routineFilter == NULL);
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(Benchmark); ++b) {
+        routineFound = routineFound || (strcmp(routineFilter, benchmarks[b].name) == 0);
+    }
+    if (!routineFound) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    driverBuffer = (uint8_t*)malloc((size_t)counts[ledCountSize - 1] * 3);
+
+    printf("%-26s %8s %10s %14s %10s\n", "routine", "leds", "frames", "ns/frame", "ns/LED");
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(Benchmark); ++b) {
+        if (routineFilter && strcmp(routineFilter, benchmarks[b].name) != 0) {
+            continue;
+        }
+        for (size_t l = 0; l < ledCountSize; ++l) {
+            unsigned long frames = 0;
+            double nsPerFrame = timeFrames(benchmarks[b], counts[l], budgetNs, &frames);
+            printf("%-26s %8lu %10lu %14.1f %10.2f\n",
+                   benchmarks[b].name,
+                   (unsigned long)counts[l],
+                   frames,
+                   nsPerFrame,
+                   nsPerFrame / counts[l]);
+            fflush(stdout);
+        }
+    }
+    free(driverBuffer);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*!
+ * \file frame_check.cpp
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Draws frames of the routines and compares them with the frames they should show, for
+ * behavior that the benchmarks would not notice when it changes. Each check prints the
+ * frame where it went wrong, and the program fails if any check does.
+ *
+ * Usage: `arducor_frame_check`
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ArduCor.h"
+
+const ArduCor::LEDIndex checkLEDs = 64;
+
+int failures = 0;
+
+/*!
+ * Counts a failed check and prints where it failed.
+ */
+bool expect(bool passed, const char* check, int frame, int shown)
+{
+    if (!passed) {
+        printf("%s: wrong value %d on frame %d\n", check, shown, frame);
+        ++failures;
+    }
+    return passed;
+}
+
+//================================================================================
+// Checks
+//================================================================================
+
+// a fade in starts dark and brightens every frame until it starts over, a fade out
+// starts at full brightness and darkens.
+void checkSawtoothFade(bool fadeIn)
+{
+    const char* check = fadeIn ? "sawtooth fade in" : "sawtooth fade out";
+    ArduCor routines(checkLEDs);
+    int first = -1;
+    int last = -1;
+    for (int frame = 0; frame < 250; ++frame) {
+        routines.singleSawtoothFade(200, 0, 0, fadeIn);
+        int red = routines.red(0);
+        if (frame == 0) {
+            first = red;
+            if (!expect(red == (fadeIn ? 0 : 200), check, frame, red)) {
+                return;
+            }
+        } else if (red == first) {
+            // the fade started over, which it can only do from the other end
+            if (!expect(last == (fadeIn ? 200 : 0), check, frame - 1, last)) {
+                return;
+            }
+        } else if (!expect(fadeIn ? (red > last) : (red < last), check, frame, red)) {
+            return;
+        }
+        last = red;
+    }
+}
+
+// draws a frame of a wave the way the samples do, with the brightness applied before
+// the frame is copied out.
+void drawWave(ArduCor& routines, uint8_t* frame)
+{
+    routines.singleWave(180, 0, 0);
+    routines.applyBrightness();
+    routines.copyFrame(frame, ArduCor::eOrderRGB, 0, checkLEDs);
+}
+
+// the wave is a single color routine, so it stays at full brightness when the brightness
+// is set to the value it already has, and comes back to it after the brightness changes.
+void checkWaveBrightness()
+{
+    const char* check = "single wave brightness";
+    ArduCor reference(checkLEDs);
+    ArduCor routines(checkLEDs);
+    reference.brightness(50);
+    routines.brightness(50);
+    uint8_t expected[checkLEDs * 3];
+    uint8_t shown[checkLEDs * 3];
+    for (int frame = 0; frame < 200; ++frame) {
+        drawWave(reference, expected);
+        if (frame == 100) {
+            // changes the brightness, which may dim this frame but not the ones after it
+            routines.brightness(40);
+            routines.applyBrightness();
+            routines.brightness(50);
+            routines.applyBrightness();
+        } else {
+            routines.brightness(routines.brightness());
+            routines.applyBrightness();
+        }
+        drawWave(routines, shown);
+        if (!expect(memcmp(expected, shown, sizeof(shown)) == 0, check, frame, shown[0])) {
+            return;
+        }
+    }
+}
+
+// a wave on a strip shorter than two bars still has two levels instead of dividing by
+// zero, and the waves and bars on the longest strip a 16 bit index counts finish drawing.
+void checkPatternLengths()
+{
+    const char* check = "pattern strip length";
+    for (ArduCor::LEDIndex count = 1; count <= 8; ++count) {
+        ArduCor routines(count);
+        for (int frame = 0; frame < 20; ++frame) {
+            routines.singleWave(180, 0, 0);
+            if (!expect(routines.red(0) <= 180, check, frame, routines.red(0))) {
+                return;
+            }
+        }
+    }
+    ArduCor routines(65535);
+    for (int frame = 0; frame < 3; ++frame) {
+        routines.singleWave(180, 0, 0);
+        routines.multiBars(eRGB, 4);
+    }
+}
+
+// a frame of one color only counts as changed when the color shown changes, also while
+// the brightness dims it, and a new brightness dims the color as it was drawn.
+void checkFillChanges()
+{
+    const char* check = "single color frame changes";
+    ArduCor routines(checkLEDs);
+    routines.brightness(50);
+    uint8_t shown[checkLEDs * 3];
+    for (int frame = 0; frame < 20; ++frame) {
+        if (frame == 10) {
+            routines.brightness(40);
+        }
+        routines.multiGlimmer(eRGB, 0);
+        routines.applyBrightness();
+        bool changed = routines.frameChanged();
+        routines.clearFrameChanged();
+        routines.copyFrame(shown, ArduCor::eOrderRGB, 0, checkLEDs);
+        if (!expect(changed == ((frame == 0) || (frame == 10)), check, frame, changed)
+            || !expect(shown[0] == ((frame < 10) ? 127 : 102), check, frame, shown[0])) {
+            return;
+        }
+    }
+}
+
+//================================================================================
+// Main
+//================================================================================
+
+int main()
+{
+    checkSawtoothFade(true);
+    checkSawtoothFade(false);
+    checkWaveBrightness();
+    checkFillChanges();
+    checkPatternLengths();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
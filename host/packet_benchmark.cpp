@@ -0,0 +1,325 @@
+/*!
+ * \file packet_benchmark.cpp
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Measures how quickly the ASCII packets of the Corluma samples are parsed, with
+ * ArduCorParser and with the strtok() based parsing the samples used before it. Both
+ * parse the same packets, and the values they read are compared so that a faster parser
+ * can't hide a wrong one.
+ *
+ * The packets come from corpora that match what the Corluma app sends, or from a file
+ * with a packet on each line, such as a serial log. The `;` at the end of a serial packet
+ * is optional.
+ *
+ * Usage: `arducor_packet_benchmark [--quick] [--corpus <file>]`
+ *
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ArduCorParser.h"
+
+// the largest packet of the samples, and the largest number of values in one message.
+const int max_packet_size = 200;
+const int max_number_of_ints = 15;
+
+typedef std::vector<std::string> Corpus;
+
+//================================================================================
+// Corpora
+//================================================================================
+
+/*!
+ * Adds the CRC to the messages of a packet, the way the Corluma app sends them.
+ */
+std::string withCRC(const std::string& messages)
+{
+    char crc[16];
+    snprintf(crc, sizeof(crc), "#%lu&", (unsigned long)ArduCorParser::crc(messages.c_str()));
+    return messages + crc;
+}
+
+// the app polls for the state of each device while it is open.
+Corpus stateCorpus()
+{
+    Corpus corpus;
+    corpus.push_back(withCRC("6&"));
+    corpus.push_back(withCRC("7,1&"));
+    return corpus;
+}
+
+// a single message that changes the routine, the brightness or the power.
+Corpus modeCorpus()
+{
+    Corpus corpus;
+    corpus.push_back(withCRC("1,1,10,6,100,4&"));
+    corpus.push_back(withCRC("1,1,3,0,255,0,100,15&"));
+    corpus.push_back(withCRC("1,1,2,0,255,0,100&"));
+    corpus.push_back(withCRC("3,1,75&"));
+    corpus.push_back(withCRC("0,1,1&"));
+    corpus.push_back(withCRC("5,1,120&"));
+    return corpus;
+}
+
+// the app sends every custom color at once, as full as packets get.
+Corpus customCorpus()
+{
+    Corpus corpus;
+    std::string messages = "4,1,10&";
+    for (int i = 0; i < 10; ++i) {
+        char message[32];
+        snprintf(message, sizeof(message), "2,1,%d,%d,%d,%d&", i, (i * 25) % 256, 255 - i * 20, i * 7);
+        if (withCRC(messages + message).size() >= (size_t)max_packet_size) {
+            break;
+        }
+        messages += message;
+    }
+    corpus.push_back(withCRC(messages));
+    return corpus;
+}
+
+bool readCorpus(const char* path, Corpus* corpus)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        size_t length = strcspn(line, ";\r\n");
+        if ((length > 0) && (length < (size_t)max_packet_size)) {
+            corpus->push_back(std::string(line, length));
+        }
+    }
+    fclose(file);
+    return !corpus->empty();
+}
+
+//================================================================================
+// Parsers
+//================================================================================
+
+// what a parser read from a packet, compared between the parsers.
+struct ParseResult
+{
+    unsigned long messages;
+    unsigned long values;
+    unsigned long sum;
+    unsigned long echoed;
+
+    bool operator==(const ParseResult& other) const
+    {
+        return (messages == other.messages) && (values == other.values)
+               && (sum == other.sum) && (echoed == other.echoed);
+    }
+};
+
+char current_packet[max_packet_size];
+char echo_message  [max_packet_size];
+char temp_packet   [max_packet_size];
+int packet_int_array[max_number_of_ints];
+
+/*!
+ * The parsing of the samples before ArduCorParser: the packet is checked with one pass
+ * for its characters and more for its CRC, and each message is copied twice before it
+ * is split with strtok().
+ */
+bool legacyCheck(char* message)
+{
+    int hashCount = 0;
+    for (int i = 0; message[i] != 0; ++i) {
+        if (!(isdigit(message[i]) || message[i] == ',' || message[i] == '&'
+              || message[i] == '#' || message[i] == '-')) {
+            return false;
+        }
+        if (message[i] == '#') {
+            hashCount++;
+        }
+    }
+    if (hashCount != 1) {
+        return false;
+    }
+    strtok(message, "#");
+    char* crcASCII = strtok(0, "&");
+    uint32_t computedCRC = ArduCorParser::crc(message);
+    return computedCRC == (uint32_t)strtoul(crcASCII, NULL, 0);
+}
+
+void legacyParse(const std::string& packet, ParseResult* result)
+{
+    memcpy(current_packet, packet.c_str(), packet.size() + 1);
+    if (!legacyCheck(current_packet)) {
+        return;
+    }
+    char* payloadEnd = current_packet + strlen(current_packet);
+    char* messagePtr = strtok(current_packet, "&");
+    while (messagePtr != 0) {
+        strcpy(temp_packet, messagePtr);
+        strcpy(echo_message, messagePtr);
+        // the values are split with their own strtok(), which loses the position of the
+        // messages, so the next one is found from the end of this one
+        char* next = messagePtr + strlen(messagePtr) + 1;
+        int count = 0;
+        char* valuePtr = strtok(temp_packet, ",");
+        while (valuePtr != 0) {
+            if (count < max_number_of_ints) {
+                packet_int_array[count] = atoi(valuePtr);
+            }
+            ++count;
+            valuePtr = strtok(0, ",");
+        }
+        if (count > max_number_of_ints) {
+            count = 0;
+        }
+        if (count > 0) {
+            ++result->messages;
+            result->values += count;
+            for (int i = 0; i < count; ++i) {
+                result->sum += packet_int_array[i];
+            }
+            strcat(echo_message, "&");
+            result->echoed += strlen(echo_message) - 1;
+        }
+        messagePtr = (next < payloadEnd) ? strtok(next, "&") : 0;
+    }
+}
+
+void singlePassParse(const std::string& packet, ParseResult* result)
+{
+    memcpy(current_packet, packet.c_str(), packet.size() + 1);
+    if (!ArduCorParser::checkPacket(current_packet, true)) {
+        return;
+    }
+    const char* message = current_packet;
+    while (*message != 0) {
+        uint8_t count;
+        const char* end = ArduCorParser::parseMessage(message, packet_int_array, max_number_of_ints, &count);
+        if (count > 0) {
+            ++result->messages;
+            result->values += count;
+            for (int i = 0; i < count; ++i) {
+                result->sum += packet_int_array[i];
+            }
+            result->echoed += end - message;
+        }
+        message = ArduCorParser::nextMessage(end);
+    }
+}
+
+//================================================================================
+// Timing
+//================================================================================
+
+typedef std::chrono::steady_clock Clock;
+typedef void (*Parser)(const std::string& packet, ParseResult* result);
+
+/*!
+ * Parses the corpus over and over until `budgetNs` has passed, then returns the average
+ * cost of a packet.
+ */
+double timeParser(Parser parser, const Corpus& corpus, double budgetNs, ParseResult* result)
+{
+    // the result of the first pass over the corpus is the one that gets compared
+    memset(result, 0, sizeof(ParseResult));
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        parser(corpus[i], result);
+    }
+
+    ParseResult ignored;
+    memset(&ignored, 0, sizeof(ParseResult));
+    unsigned long packets = 0;
+    double elapsedNs = 0;
+    Clock::time_point start = Clock::now();
+    while (elapsedNs < budgetNs) {
+        for (int repeat = 0; repeat < 64; ++repeat) {
+            for (size_t i = 0; i < corpus.size(); ++i) {
+                parser(corpus[i], &ignored);
+            }
+        }
+        packets += 64 * corpus.size();
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+    // keeps the parsing from being optimized away
+    if (ignored.sum == 1) {
+        printf(" ");
+    }
+    return elapsedNs / packets;
+}
+
+//================================================================================
+// Main
+//================================================================================
+
+void printUsage(const char* program)
+{
+    printf("usage: %s [--quick] [--corpus <file>]\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    double budgetNs = 500e6;
+    const char* corpusPath = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            budgetNs = 20e6;
+        } else if ((strcmp(argv[i], "--corpus") == 0) && (i + 1 < argc)) {
+            corpusPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<std::string, Corpus> > corpora;
+    if (corpusPath) {
+        Corpus corpus;
+        if (!readCorpus(corpusPath, &corpus)) {
+            printf("no packets in %s\n", corpusPath);
+            return 1;
+        }
+        corpora.push_back(std::make_pair(std::string(corpusPath), corpus));
+    } else {
+        corpora.push_back(std::make_pair(std::string("state"), stateCorpus()));
+        corpora.push_back(std::make_pair(std::string("mode"), modeCorpus()));
+        corpora.push_back(std::make_pair(std::string("custom"), customCorpus()));
+    }
+
+    printf("packet buffers: %d bytes with strtok, %d bytes single pass\n",
+           (int)(sizeof(current_packet) + sizeof(echo_message) + sizeof(temp_packet)),
+           (int)sizeof(current_packet));
+    printf("%-12s %8s %12s %12s %12s %10s\n", "corpus", "bytes", "strtok ns", "single ns", "single MB/s", "speedup");
+    int mismatches = 0;
+    for (size_t c = 0; c < corpora.size(); ++c) {
+        const Corpus& corpus = corpora[c].second;
+        size_t bytes = 0;
+        for (size_t i = 0; i < corpus.size(); ++i) {
+            bytes += corpus[i].size();
+        }
+        ParseResult legacy;
+        ParseResult singlePass;
+        double legacyNs = timeParser(legacyParse, corpus, budgetNs, &legacy);
+        double singlePassNs = timeParser(singlePassParse, corpus, budgetNs, &singlePass);
+        if (!(legacy == singlePass)) {
+            ++mismatches;
+        }
+        double bytesPerPacket = (double)bytes / corpus.size();
+        printf("%-12s %8.1f %12.1f %12.1f %12.1f %10.2f%s\n",
+               corpora[c].first.c_str(),
+               bytesPerPacket,
+               legacyNs,
+               singlePassNs,
+               bytesPerPacket * 1e3 / singlePassNs,
+               legacyNs / singlePassNs,
+               (legacy == singlePass) ? "" : "  values differ");
+        fflush(stdout);
+    }
+    return mismatches ? 1 : 0;
+}
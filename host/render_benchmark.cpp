@@ -0,0 +1,162 @@
+/*!
+ * \file render_benchmark.cpp
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Measures how many zones the RenderScheduler draws each second as the number of threads
+ * grows. Each zone is an ArduCor object with its own strip, drawn the way the Corluma
+ * sample draws a device: a step of its routine, the brightness, and a copy into the
+ * driver buffer.
+ *
+ * Usage: `arducor_render_benchmark [--quick] [--zones <count>] [--leds <count>] [--threads <count>]`
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "RenderScheduler.h"
+
+//================================================================================
+// Zones
+//================================================================================
+
+// routines given to the zones in turn, so the threads get a mix of cheap and costly ones.
+struct ZoneRoutine
+{
+    uint8_t  routine;
+    EPalette palette;
+    uint16_t parameter;
+};
+
+const ZoneRoutine zoneRoutines[] = {
+    { eMultiBars,             eSevenColor, 4 },
+    { eSingleGlimmer,         eCustom,     10 },
+    { eMultiGlimmer,          eFire,       10 },
+    { eSingleFade,            eCustom,     1 },
+    { eMultiRandomIndividual, eFire,       0 },
+    { eSingleWave,            eCustom,     0 },
+    { eMultiFade,             eSevenColor, 0 },
+};
+const size_t zoneRoutineCount = sizeof(zoneRoutines) / sizeof(ZoneRoutine);
+
+// stands in for the buffers of the LED drivers, one for each zone.
+uint8_t *driverBuffers;
+ArduCor::LEDIndex zoneLEDs;
+
+void drawZone(ArduCor& routines, size_t index)
+{
+    const ZoneRoutine& zone = zoneRoutines[index % zoneRoutineCount];
+    routines.runRoutine(zone.routine, zone.palette, zone.parameter);
+    routines.applyBrightness();
+    routines.copyFrame(driverBuffers + index * zoneLEDs * 3, ArduCor::eOrderGRB, 0, zoneLEDs);
+}
+
+//================================================================================
+// Timing
+//================================================================================
+
+typedef std::chrono::steady_clock Clock;
+
+/*!
+ * Draws frames of every zone until `budgetNs` has passed, then returns the average cost
+ * of a frame.
+ */
+double timeFrames(RenderScheduler& scheduler, const std::vector<ArduCor*>& zones, double budgetNs, unsigned long* frameCount)
+{
+    RenderScheduler::RenderFunction render = drawZone;
+    // warm up the routines and the threads so that their setup isn't part of the measurement.
+    for (int i = 0; i < 4; ++i) {
+        scheduler.renderFrame(&zones[0], zones.size(), render);
+    }
+
+    unsigned long frames = 0;
+    double elapsedNs = 0;
+    Clock::time_point start = Clock::now();
+    while (elapsedNs < budgetNs) {
+        scheduler.renderFrame(&zones[0], zones.size(), render);
+        ++frames;
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+    *frameCount = frames;
+    return elapsedNs / frames;
+}
+
+//================================================================================
+// Main
+//================================================================================
+
+void printUsage(const char* program)
+{
+    printf("usage: %s [--quick] [--zones <count>] [--leds <count>] [--threads <count>]\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    double budgetNs = 500e6;
+    long zoneCount = 256;
+    long ledCount = 120;
+    long maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads < 1) {
+        maxThreads = 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            budgetNs = 20e6;
+        } else if ((strcmp(argv[i], "--zones") == 0) && (i + 1 < argc)) {
+            zoneCount = atol(argv[++i]);
+        } else if ((strcmp(argv[i], "--leds") == 0) && (i + 1 < argc)) {
+            ledCount = atol(argv[++i]);
+        } else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+            maxThreads = atol(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if ((zoneCount < 1) || (ledCount < 1) || (maxThreads < 1)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    zoneLEDs = (ArduCor::LEDIndex)ledCount;
+    driverBuffers = (uint8_t*)malloc((size_t)zoneCount * zoneLEDs * 3);
+    std::vector<ArduCor*> zones;
+    for (long i = 0; i < zoneCount; ++i) {
+        ArduCor *routines = new ArduCor(zoneLEDs, ArduCor::eOrderGRB);
+        routines->seedRandom(i + 1);
+        routines->brightness(50);
+        zones.push_back(routines);
+    }
+
+    printf("%d zones of %d LEDs\n", (int)zoneCount, (int)zoneLEDs);
+    printf("%8s %10s %14s %14s %10s\n", "threads", "frames", "us/frame", "zones/s", "speedup");
+    double singleThreadNs = 0;
+    for (long threads = 1; threads <= maxThreads; ++threads) {
+        RenderScheduler scheduler((unsigned)threads);
+        unsigned long frames = 0;
+        double nsPerFrame = timeFrames(scheduler, zones, budgetNs, &frames);
+        if (threads == 1) {
+            singleThreadNs = nsPerFrame;
+        }
+        printf("%8ld %10lu %14.1f %14.0f %10.2f\n",
+               threads,
+               frames,
+               nsPerFrame / 1e3,
+               zoneCount * 1e9 / nsPerFrame,
+               singleThreadNs / nsPerFrame);
+        fflush(stdout);
+    }
+
+    for (size_t i = 0; i < zones.size(); ++i) {
+        delete zones[i];
+    }
+    free(driverBuffers);
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*!
+ * \file Adafruit_NeoPixel.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Stand-in for the Adafruit NeoPixel driver, which keeps the pixels in a buffer that the
+ * host program can read instead of sending them to a strip.
+ *
+ */
+
+#ifndef ArduCor_Host_Adafruit_NeoPixel_h
+#define ArduCor_Host_Adafruit_NeoPixel_h
+
+#include <stdint.h>
+#include <vector>
+
+#define NEO_GRB    0x52
+#define NEO_KHZ800 0x0000
+
+class Adafruit_NeoPixel
+{
+public:
+    Adafruit_NeoPixel(uint16_t count, uint8_t, uint16_t) : m_pixels((size_t)count * 3), m_shows(0) {}
+
+    void begin() {}
+
+    void show() { ++m_shows; }
+
+    uint8_t* getPixels() { return m_pixels.data(); }
+
+    /*!
+     * Retrieve the number of times the pixels were sent to the strip.
+     */
+    unsigned long shows() { return m_shows; }
+
+private:
+    std::vector<uint8_t> m_pixels;
+    unsigned long m_shows;
+};
+
+#endif // ArduCor_Host_Adafruit_NeoPixel_h
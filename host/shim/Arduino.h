@@ -0,0 +1,93 @@
+/*!
+ * \file Arduino.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Minimal stand-in for the Arduino core used when ArduCor is compiled natively on a
+ * host machine. It only provides the types and functions that the library and the
+ * serial samples rely on, so the render code can be built and profiled, and the samples
+ * checked, without flashing a board.
+ *
+ */
+
+#ifndef ArduCor_Host_Arduino_h
+#define ArduCor_Host_Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "avr/pgmspace.h"
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+// strings are kept in RAM on the host.
+#define F(string) (string)
+
+/*!
+ * Matches avr-libc: writes `value` in base 10 to `buffer` and returns it.
+ */
+inline char* itoa(int value, char* buffer, int)
+{
+    sprintf(buffer, "%d", value);
+    return buffer;
+}
+
+/*!
+ * Matches avr-libc: writes `value` in base 10 to `buffer` and returns it.
+ */
+inline char* ultoa(unsigned long value, char* buffer, int)
+{
+    sprintf(buffer, "%lu", value);
+    return buffer;
+}
+
+/*!
+ * Matches the AVR core: returns a value between 0 and `howbig - 1`.
+ */
+inline long random(long howbig)
+{
+    if (howbig == 0) {
+        return 0;
+    }
+    return ::random() % howbig;
+}
+
+/*!
+ * Matches the AVR core: returns a value between `howsmall` and `howbig - 1`.
+ */
+inline long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+    return random(howbig - howsmall) + howsmall;
+}
+
+inline void randomSeed(unsigned long seed)
+{
+    if (seed != 0) {
+        srandom(seed);
+    }
+}
+
+/*!
+ * Milliseconds since the first call, similar to the time since boot on a board.
+ */
+inline unsigned long millis()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+#include "HardwareSerial.h"
+
+#endif // ArduCor_Host_Arduino_h
@@ -0,0 +1,64 @@
+/*!
+ * \file HardwareSerial.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Stand-in for the serial port of a board. The bytes a host program gives to `input`
+ * are read by the sketch, and the bytes the sketch writes are kept in `output`.
+ *
+ */
+
+#ifndef ArduCor_Host_HardwareSerial_h
+#define ArduCor_Host_HardwareSerial_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+class HardwareSerial
+{
+public:
+    std::string input;
+    std::string output;
+
+    void begin(unsigned long) {}
+
+    int available() { return (int)(input.size() - m_read); }
+
+    int read()
+    {
+        if (m_read == input.size()) {
+            return -1;
+        }
+        int data = (uint8_t)input[m_read++];
+        if (m_read == input.size()) {
+            input.clear();
+            m_read = 0;
+        }
+        return data;
+    }
+
+    size_t write(uint8_t data)
+    {
+        output += (char)data;
+        return 1;
+    }
+
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+
+    size_t write(const uint8_t* data, size_t length)
+    {
+        output.append((const char*)data, length);
+        return length;
+    }
+
+private:
+    size_t m_read = 0;
+};
+
+// defined by the host program that runs a sketch.
+extern HardwareSerial Serial;
+
+#endif // ArduCor_Host_HardwareSerial_h
@@ -0,0 +1,27 @@
+/*!
+ * \file pgmspace.h
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Host version of `avr/pgmspace.h`. There is only one address space on a host machine,
+ * so program memory reads become plain dereferences. Reading through the pointer's own
+ * type (instead of a fixed 16-bit word) keeps tables of pointers such as `colorPresets`
+ * valid on 64-bit hosts.
+ *
+ */
+
+#ifndef ArduCor_Host_pgmspace_h
+#define ArduCor_Host_pgmspace_h
+
+#include <string.h>
+
+#define PROGMEM
+
+#define pgm_read_byte_near(addr)  (*(addr))
+#define pgm_read_word_near(addr)  (*(addr))
+#define pgm_read_dword_near(addr) (*(addr))
+
+#define memcpy_P memcpy
+
+#endif // ArduCor_Host_pgmspace_h
@@ -0,0 +1,163 @@
+/*!
+ * \file sketch_check.cpp
+ * \copyright <a href="https://github.com/timsee/ArduCor/blob/master/LICENSE">
+ *            MIT License
+ *            </a>
+ *
+ * Runs the NeoPixels serial sample on the host with the serial port and the strip of the
+ * shim, and checks how it handles the packets it receives and what it draws for them.
+ * Each check prints what went wrong, and the program fails if any check does.
+ *
+ * Usage: `arducor_sketch_check`
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include "Arduino.h"
+#include "ArduCor.h"
+
+HardwareSerial Serial;
+
+// the Arduino IDE declares the functions of a sketch before compiling it, so the ones
+// used before they are defined are declared here.
+void updateLEDs();
+void copyChangedLEDs(ArduCor& lights, uint8_t* pixelBuffer);
+void changeRoutine(uint8_t device);
+bool advanceRoutine(uint8_t device, unsigned long elapsed);
+uint16_t speedToStepInterval(int speed);
+int routineParameter(const struct DeviceSettings& settings);
+bool parsePacket(int header);
+bool drawRealtimeFrame(const uint8_t* data, uint8_t count);
+bool realtimeTimedOut(uint8_t device, unsigned long now);
+bool isAddressed(uint8_t device);
+bool routineParser(bool currentSuccess);
+bool isColorValid();
+void updateDevice(uint8_t device, uint8_t routine, EPalette palette, int speedValue, int param);
+void buildStateUpdatePacket();
+void buildCustomArrayUpdatePacket();
+void buildDiscoveryPacket();
+void startReply();
+void addReplyValue(int value);
+bool replyChanged();
+char* writeText(char* cursor, const char* text);
+char* writeNumber(char* cursor, int value);
+char* writeMessage(char* cursor, const int* values, uint8_t count);
+char* writePacketEnd(const char* packet, char* cursor);
+void echoPacket(const char* message, uint8_t length);
+unsigned long calculateMinutesUntilTimeout(unsigned long last_message, unsigned long timeout_max);
+bool receiveByte(uint8_t data);
+bool finishASCIIPacket();
+void parseBinaryMessages(uint8_t* packet, uint8_t length);
+void writeBinaryPacket(uint8_t* packet, uint8_t length);
+uint32_t binaryCRC(uint8_t length, const uint8_t* messages);
+uint32_t readCRC(const uint8_t* data);
+
+#include "Neopixels-Serial-Corluma-Sample.ino"
+
+int failures = 0;
+
+/*!
+ * Counts a failed check and prints why it failed.
+ */
+bool expect(bool passed, const char* check, const char* problem, int value)
+{
+    if (!passed) {
+        printf("%s: %s (%d)\n", check, problem, value);
+        ++failures;
+    }
+    return passed;
+}
+
+// multi bars on device 1, the binary packet of the sample README.
+const uint8_t modePacket[] = { 0xA5, 0x07, 0x01, 0x05, 0x01, 0x0A, 0x06, 0x64, 0x04, 0xAB, 0x93, 0xF1, 0xC9 };
+
+/*!
+ * Sends messages to the sketch in a binary packet and runs a loop of it.
+ */
+void sendBinary(const uint8_t* messages, uint8_t length)
+{
+    uint32_t crc = binaryCRC(length, messages);
+    Serial.input.clear();
+    Serial.input += (char)BINARY_PACKET_START;
+    Serial.input += (char)length;
+    Serial.input.append((const char*)messages, length);
+    for (int i = 0; i < 4; ++i) {
+        Serial.input += (char)(crc >> (8 * i));
+    }
+    loop();
+}
+
+//================================================================================
+// Checks
+//================================================================================
+
+// a binary packet whose messages and CRC don't fit in current_packet is skipped without
+// storing any of it, for every length up to the largest a byte holds.
+void checkBinaryLength()
+{
+    const char* check = "binary packet length";
+    for (int length = 0; length <= 255; ++length) {
+        receiveByte(BINARY_PACKET_START);
+        receiveByte((uint8_t)length);
+        bool fits = (length + 6 <= (int)sizeof(current_packet));
+        if (!expect(receive_state == (fits ? eReceiveBinary : eReceiveSkip), check,
+                    fits ? "packet that fits was skipped" : "packet that doesn't fit was stored", length)) {
+            return;
+        }
+        // the messages and CRC, which don't match
+        for (int i = 0; i < length + 4; ++i) {
+            receiveByte(0);
+        }
+        if (!expect(receive_state == eReceiveIdle, check, "packet didn't end after its CRC", length)) {
+            return;
+        }
+    }
+
+    // the packets after them are still received
+    Serial.output.clear();
+    Serial.input.assign((const char*)modePacket, sizeof(modePacket));
+    loop();
+    expect(Serial.output == std::string((const char*)modePacket, sizeof(modePacket)), check,
+           "packet after the long packets wasn't echoed", (int)Serial.output.size());
+}
+
+// once the realtime frames stop, the routine draws its frame again right away, even one
+// like multiRandomSolid that only draws on some of its steps.
+void checkRealtimeTimeout()
+{
+    const char* check = "realtime timeout";
+    // multiRandomSolid at the lowest speed, so it takes no step of its own
+    const uint8_t mode[] = { eModeChange, 4, 1, eMultiRandomSolid, eRGB, 1 };
+    sendBinary(mode, sizeof(mode));
+    // the first three LEDs turned off
+    const uint8_t frame[] = { eRealtimeFrame, 13, 1, 0, 0, eRealtimeRaw, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    sendBinary(frame, sizeof(frame));
+    if (!expect(devices[0].realtime && (routines.red(0) + routines.green(0) + routines.blue(0) == 0),
+                check, "realtime frame wasn't drawn", routines.red(0))) {
+        return;
+    }
+    devices[0].realtime_time = millis() - REALTIME_TIMEOUT;
+    loop();
+    expect(!devices[0].realtime, check, "realtime frames didn't time out", 0);
+    expect(routines.red(0) + routines.green(0) + routines.blue(0) != 0, check,
+           "routine wasn't drawn over the realtime frame", routines.red(0));
+}
+
+//================================================================================
+// Main
+//================================================================================
+
+int main()
+{
+    setup();
+    checkBinaryLength();
+    checkRealtimeTimeout();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
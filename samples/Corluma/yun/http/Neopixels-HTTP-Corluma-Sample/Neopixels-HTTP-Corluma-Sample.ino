@@ -12,6 +12,7 @@
  * License: MIT-License, LICENSE provided in root of git repo
  */
 #include <ArduCor.h>
+#include <ArduCorParser.h>
 
 #include <Adafruit_NeoPixel.h>
 #include <BridgeServer.h>
@@ -27,7 +28,10 @@ const int  LED_COUNT         = 64;
 const byte BAR_SIZE          = 4;      // default length of a bar for bar routines
 const byte GLIMMER_PERCENT   = 10;     // percent of "glimmering" LEDs in glimmer routines: range: 0 - 100
 
-const byte DELAY_VALUE       = 50;     // amount of sleep time between loops
+const byte STEP_TIME_UNIT    = 50;     // milliseconds added to each step of a routine for every speed value below the max
+
+const int  TRANSITION_TIME   = 500;    // milliseconds a new routine takes to fade in over the last one, 0 switches at once.
+const int  REALTIME_TIMEOUT  = 2500;   // milliseconds without a realtime frame until the routine comes back, 0 never brings it back.
 
 const int  DEFAULT_SPEED     = 100;    // default delay for LEDs update, suggested range: 0 (paused) - 200 (fast).
 const int  MAX_SPEED_VALUE   = 200;    // max speed value allowed to be sent
@@ -38,12 +42,14 @@ const int  DEFAULT_HW_INDEX  = 1;      // index for this particular microcontrol
 const int  DEVICE_COUNT      = 1;      // number of LED devices connected, 1 for every sample except the multi sample
 
 const bool USE_CRC           = false;   // true uses CRC, false ignores it.
+const uint8_t CAPABILITIES   = 0;      // ECapability flags sent in the discovery packet.
 
 //=======================
 // Hardware Name
 //=======================
 
-// rename this whatever you want, but keep it under 16 characters
+// rename this whatever you want, but keep it under 16 characters. When there
+// is more than one device, each device after the first adds its number to the name.
 char name_buffer[] = "MyLights";
 
 //=======================
@@ -90,37 +96,49 @@ EProductType product_type = eNeoPixels;
 // new functions added that do not significantly break the existing
 // messaging protocol.
 const uint8_t API_LEVEL_MAJOR = 3;
-const uint8_t API_LEVEL_MINOR = 3;
+const uint8_t API_LEVEL_MINOR = 5;
 
 
 //=======================
 // Stored Values and States
 //=======================
 
-ERoutine current_routine = eSingleGlimmer;
-EPalette current_palette = eCustom;
+// settings of a device. Every device is a segment of the same ArduCor object.
+struct DeviceSettings
+{
+  // an ERoutine, or eRoutine_MAX and up for the routines added by the sketch
+  uint8_t  routine;
+  EPalette palette;
+  // value determines how quickly the LEDs udpate. Lower values lead to faster updates
+  int update_speed;
+  bool should_update_no_speed;
+  unsigned long idle_timeout;
+  int  single_glimmer_param;
+  int  multi_glimmer_param;
+  bool sawtooth_param;
+  bool fade_param;
+  int  multi_bars_param;
+  int  custom_param;
+  // true while the device shows realtime frames instead of its routine
+  bool realtime;
+  unsigned long realtime_time;
+};
+
+DeviceSettings devices[DEVICE_COUNT];
 
 // set this to turn off echoing all together
 bool skip_echo = false;
-// the sample sets this when it receives a valid packet
-bool should_echo = false;
 
-// used in sketches with multiple hardware connected to one arduino.
+// used in sketches with multiple hardware connected to one arduino. Device n
+// uses the hardware index hardware_index + n.
 uint8_t received_hardware_index;
 uint8_t hardware_index = DEFAULT_HW_INDEX;
 
-// value determines how quickly the LEDs udpate. Lower values lead to faster updates
-int update_speed = DEFAULT_SPEED;
-bool should_update_no_speed = false;
-
-
 // timeout variables
-unsigned long idle_timeout = (unsigned long)DEFAULT_TIMEOUT * 60 * 1000; // convert to milliseconds
 unsigned long last_message_time = 0;
 
-// counts each loop and uses it to determine
-// when to update the LEDs.
-unsigned long loop_counter = 0;
+// time of the last loop, the routines move forward by the time since then.
+unsigned long last_frame_time = 0;
 
 //=======================
 // String Parsing
@@ -133,10 +151,9 @@ bool packetReceived = false;
 // ints used for determining how much memory to use
 const int max_packet_size = 200;
 
-// buffers for receiving messages
+// buffer for receiving messages. They are parsed and echoed where they are, without
+// being copied.
 char current_packet[max_packet_size];
-char echo_message  [max_packet_size];
-char temp_packet   [max_packet_size];
 
 // buffers for converting ASCII to an int array
 const int max_number_of_ints = 15;
@@ -146,10 +163,26 @@ int packet_int_array[max_number_of_ints];
 // converting them to int arrays.
 int multi_packet_size = 0;
 int current_multi_packet = 0;
-int int_array_size = 0;
-
-// buffers for char arrays
-char state_update_packet[110];
+uint8_t int_array_size = 0;
+
+// longest state update message of one device.
+const int max_state_update_size = 56;
+// longest custom array update of one device: a message with 10 colors, its CRC, ";" and
+// the newline. The custom array update of every device is longer than the state update.
+const int max_custom_array_update_size = 144;
+
+// buffers for char arrays. The state update packet holds the last state update or
+// custom array update, which is sent again as long as its values stay the same.
+char state_update_packet[max_custom_array_update_size * DEVICE_COUNT + 1];
+
+// values of the reply in state_update_packet, 13 for each device in a state update, or
+// the header, hardware index, count and colors of a custom array update.
+const int max_reply_values = (13 * DEVICE_COUNT > 33) ? 13 * DEVICE_COUNT : 33;
+int reply_values[max_reply_values];
+uint8_t reply_value_count = 0;
+// number of values compared with reply_values so far, and whether any of them changed.
+uint8_t reply_value_index = 0;
+bool reply_changed = false;
 
 char discovery_packet[54];
 
@@ -162,15 +195,6 @@ const char packet_delimiter[] = ";";
 const char names_delimiter[] = "@";
 const char new_line[] = "\n";
 
-int  single_glimmer_param = GLIMMER_PERCENT;
-int  multi_glimmer_param  = GLIMMER_PERCENT;
-bool sawtooth_param       = false;
-bool fade_param           = false;
-int  multi_bars_param     = BAR_SIZE;
-
-
-bool reset_counter = false;
-
 //=======================
 // Yun Setup
 //=======================
@@ -181,8 +205,12 @@ BridgeServer server;
 //=======================
 // ArduCor Setup
 //=======================
-// Library used to generate the RGB LED routines.
-ArduCor routines = ArduCor(LED_COUNT);
+// Library used to generate the RGB LED routines. Its buffers are sized by
+// LED_COUNT when the sketch is compiled, so they count towards the memory the
+// IDE reports. It stores the LEDs in the same channel order as the NeoPixels so
+// frames can be copied straight into the NeoPixels buffer. If you change NEO_GRB
+// below, change this to match.
+StaticArduCor<LED_COUNT> routines(ArduCor::eOrderGRB);
 
 //=======================
 // Hardware Setup
@@ -192,41 +220,86 @@ ArduCor routines = ArduCor(LED_COUNT);
 Adafruit_NeoPixel pixels = Adafruit_NeoPixel(LED_COUNT, CONTROL_PIN, NEO_GRB + NEO_KHZ800);
 
 //=======================
-// CRC-32
+// Custom Routines
 //=======================
-// Based on this guide http://excamera.com/sphinx/article-crc.html
-// 8-bit CRC is too little, 32-bit is a bit overkill but this method
-// is really elegant and uses very little PROGMEM
+// Routines added by the sketch next to the ones built into ArduCor. The first one
+// gets the routine value eRoutine_MAX, the next eRoutine_MAX + 1 and so on, and they
+// are chosen by the same routine packets as the built in routines. Routines that use
+// the palette take the packet of eMultiGlimmer, the others take the packet of
+// eSingleGlimmer, and the last value of the packet is given to the routine.
 
-const PROGMEM uint32_t crcTable[16] = 
+/*!
+ * @brief drawChase Lights every spacing-th LED with the next color of the palette
+ *        over the first color of the palette, and moves the lit LEDs one LED each frame.
+ *
+ * @param lights the ArduCor object, with the segment of the device selected.
+ * @param spacing the number of LEDs from one lit LED to the next.
+ */
+void drawChase(ArduCor& lights, uint16_t spacing)
 {
-  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
-  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
-  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
-  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
-};
+  if (spacing == 0) {
+    spacing = 1;
+  }
+  // the position of the chase is kept between frames in the routine state
+  uint16_t* offset = (uint16_t*)lights.routineState();
+  *offset = (*offset + lights.routineSteps()) % spacing;
+
+  ArduCor::Color background = lights.paletteColor(0);
+  lights.fill(background.red, background.green, background.blue);
+  uint8_t colorCount = lights.paletteSize();
+  uint8_t colorIndex = 1;
+  for (ArduCor::LEDIndex i = *offset; i < lights.ledCount(); i += spacing) {
+    if (colorIndex >= colorCount) {
+      colorIndex = (colorCount > 1) ? 1 : 0;
+    }
+    ArduCor::Color color = lights.paletteColor(colorIndex++);
+    lights.setPixel(i, color.red, color.green, color.blue);
+  }
+  lights.markChanged(0, lights.ledCount() - 1);
+}
 
-unsigned long crcUpdate(unsigned long crc, byte data)
+/*!
+ * @brief drawGradient Blends smoothly through the colors of the palette along the LEDs,
+ *        and moves the blend one LED each step.
+ *
+ * @param lights the ArduCor object, with the segment of the device selected.
+ * @param length the number of LEDs it takes to blend through the whole palette, or 0
+ *        to blend through it once along the device.
+ */
+void drawGradient(ArduCor& lights, uint16_t length)
 {
-  byte tableIndex;
-  tableIndex = crc ^ (data >> (0 * 4));
-  crc = pgm_read_dword_near(crcTable + (tableIndex & 0x0f)) ^ (crc >> 4);
-  tableIndex = crc ^ (data >> (1 * 4));
-  crc = pgm_read_dword_near(crcTable + (tableIndex & 0x0f)) ^ (crc >> 4);
-  return crc;
+  const ArduCor::Color* gradient = lights.paletteGradient();
+  if (!gradient) {
+    // not enough memory for the gradient, so show the first color of the palette instead
+    ArduCor::Color color = lights.paletteColor(0);
+    lights.fill(color.red, color.green, color.blue);
+    return;
+  }
+  if ((length == 0) || (length > lights.ledCount())) {
+    length = lights.ledCount();
+  }
+  uint16_t* offset = (uint16_t*)lights.routineState();
+  *offset = (*offset + lights.routineSteps()) % length;
+
+  // the phase is kept in 8.8 fixed point, and a whole pass through the gradient is
+  // 65536, so it wraps around on its own.
+  uint16_t step = 65536UL / length;
+  uint16_t phase = *offset * step;
+  for (ArduCor::LEDIndex i = 0; i < lights.ledCount(); ++i) {
+    const ArduCor::Color& color = gradient[phase >> 8];
+    lights.setPixel(i, color.red, color.green, color.blue);
+    phase += step;
+  }
+  lights.markChanged(0, lights.ledCount() - 1);
 }
 
-unsigned long crcCalculator(const char* packet)
+const ArduCor::CustomRoutine custom_routines[] =
 {
-  unsigned long crc = ~0L;
-  uint16_t i = 0;
-  while (packet[i] != 0) {
-    crc = crcUpdate(crc, packet[i]);
-    ++i;
-  }
-  crc = ~crc;
-  return crc;
-}
+  // setup, draw, uses palette
+  { 0, drawChase,    true },
+  { 0, drawGradient, true },
+};
+const uint8_t CUSTOM_ROUTINE_COUNT = sizeof(custom_routines) / sizeof(ArduCor::CustomRoutine);
 
 //================================================================================
 // Setup and Loop
@@ -235,15 +308,35 @@ unsigned long crcCalculator(const char* packet)
 void setup()
 {
   pixels.begin();
+  routines.setCustomRoutines(custom_routines, CUSTOM_ROUTINE_COUNT);
+
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    devices[device].routine                = eSingleGlimmer;
+    devices[device].palette                = eCustom;
+    devices[device].update_speed           = DEFAULT_SPEED;
+    devices[device].should_update_no_speed = false;
+    devices[device].idle_timeout           = (unsigned long)DEFAULT_TIMEOUT * 60 * 1000; // convert to milliseconds
+    devices[device].single_glimmer_param   = GLIMMER_PERCENT;
+    devices[device].multi_glimmer_param    = GLIMMER_PERCENT;
+    devices[device].sawtooth_param         = false;
+    devices[device].fade_param             = false;
+    devices[device].multi_bars_param       = BAR_SIZE;
+    devices[device].custom_param           = 0;
+    devices[device].realtime               = false;
+    devices[device].realtime_time          = 0;
+
+    // choose the default color for the single
+    // color routines. This can be changed at any time.
+    // and its set it to green in sample routines.
+    // If its not set, it defaults to a faint orange.
+    routines.selectSegment(device);
+    routines.setMainColor(0, 127, 0);
+    routines.stepInterval(speedToStepInterval(DEFAULT_SPEED));
+  }
 
   Bridge.begin();
   server.listenOnLocalhost();
   server.begin();
-  // choose the default color for the single
-  // color routines. This can be changed at any time.
-  // and its set it to green in sample routines.
-  // If its not set, it defaults to a faint orange.
-  routines.setMainColor(0, 127, 0);
   buildDiscoveryPacket();
 }
 
@@ -267,146 +360,165 @@ void loop()
     }
   }
   if (packetReceived) {
-    memset(echo_message, 0, sizeof(echo_message));
     /// make a pointer we can manipulate during packet parsing
     char* packetPtr = current_packet;
     // strip newline
     packetPtr = strtok(packetPtr, "\r");
     packetPtr = strtok(packetPtr, "\n");
-    bool messageIsValid = checkIfPacketIsValid(packetPtr);
+    bool messageIsValid = (packetPtr != 0) && ArduCorParser::checkPacket(packetPtr, USE_CRC);
     skip_echo = false;
-    should_echo = false;
-    should_update_no_speed = false; 
     if (messageIsValid) { 
-      // go through each message packet
-     char* messagePtr = strtok(packetPtr, "&");
-      while (messagePtr != 0) {
-        if (!skip_echo) {
-          strcpy(temp_packet, messagePtr); // Copy for parsing a destructive way
-          strcpy(echo_message, messagePtr); // save for echoing 
-        }
-        // Find the next substring delimited by a "&"
-        messagePtr = strtok(0, "&");
-        
+      // go through each message packet, the last one that is parsed gets echoed
+      const char* echoStart = 0;
+      uint8_t echoLength = 0;
+      const char* message = packetPtr;
+      while (*message != 0) {
         // convert from a array of chars into an int array
-        delimitedStringToIntArray(temp_packet);
+        const char* end = ArduCorParser::parseMessage(message,
+                                                      packet_int_array,
+                                                      max_number_of_ints,
+                                                      &int_array_size);
         // parse a paceket only if its header is is in the correct range
         if ((int_array_size > 0)
             && (packet_int_array[0] < ePacketHeader_MAX)) {
           // message is valid and the first int can be interpeted as a header
           //  attempt to parse the whole packet
           if (parsePacket(packet_int_array[0])) {
-            // if packet parsing is sucessful, echo the packet
             last_message_time = millis();
-            if (!skip_echo) {
-              strcat(echo_message, message_delimiter);
-              should_echo = true;
-            }
+            echoStart = message;
+            echoLength = end - message;
           }
         }
+        message = ArduCorParser::nextMessage(end);
       }
-      if (!skip_echo && should_echo) {
-        echoPacket();
+      if (!skip_echo && (echoStart != 0)) {
+        echoPacket(echoStart, echoLength);
       }
     }
   }
 
-  if (update_speed == 0) { 
-    if (should_update_no_speed) { 
-      changeRoutine(current_routine); 
-      routines.applyBrightness();  
-      updateLEDs();
-    } 
-  } else if (!(loop_counter % ((MAX_SPEED_VALUE + 5) - update_speed))) { 
-    changeRoutine(current_routine);
-    routines.applyBrightness();
-    updateLEDs();
-  }
+  // the routines move forward by the time that has passed, so they keep their speed no
+  // matter how long parsing packets and updating the LEDs takes.
+  unsigned long now = millis();
+  unsigned long elapsed = now - last_frame_time;
+  last_frame_time = now;
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    routines.selectSegment(device);
+    if (devices[device].realtime && !realtimeTimedOut(device, now)) {
+      // the frames come from the packets, only the fade into them moves forward
+      routines.advanceTransition(elapsed);
+    } else if (devices[device].should_update_no_speed) {
+      // a packet changed the device, so it is drawn right away even if it is paused
+      devices[device].should_update_no_speed = false;
+      changeRoutine(device);
+      routines.applyBrightness();
+    } else if (devices[device].update_speed == 0) {
+      // a paused routine still fades in over the last one
+      routines.advanceTransition(elapsed);
+    } else if (advanceRoutine(device, elapsed)) {
+      routines.applyBrightness();
+    }
 
-  // Timeout the LEDs.
-  if ((idle_timeout != 0)
-      && (last_message_time + idle_timeout < millis())) {
-    routines.turnOff();
+    // Timeout the LEDs.
+    if ((devices[device].idle_timeout != 0)
+        && (last_message_time + devices[device].idle_timeout < millis())) {
+      routines.turnOff();
+    }
   }
-
-  loop_counter++;
-  delay(DELAY_VALUE);
+  // every device draws into the same frame, which only gets sent to the
+  // LEDs when part of it has changed.
+  updateLEDs();
   client.stop();
 }
 
 
 void updateLEDs()
 {
-  for (int x = 0; x < LED_COUNT; x++) {
-    pixels.setPixelColor(x, pixels.Color(routines.red(x),
-                                         routines.green(x),
-                                         routines.blue(x)));
+  // skip the update if nothing changed since the last one, since show()
+  // blocks interrupts while it sends the whole strip.
+  if (!routines.frameChanged()) {
+    return;
   }
+  copyChangedLEDs(routines, pixels.getPixels());
   pixels.show();
 }
 
+/*!
+ * @brief copyChangedLEDs copies the LEDs that changed since the last update into the
+ *        NeoPixels buffer. The frame is already in the NeoPixels channel order, so this
+ *        is a single copy.
+ */
+void copyChangedLEDs(ArduCor& lights, uint8_t* pixelBuffer)
+{
+  if (lights.frameChanged()) {
+    uint16_t first = lights.changedFirst();
+    lights.copyFrame(pixelBuffer + first * 3,
+                     ArduCor::eOrderGRB,
+                     first,
+                     lights.changedLast() - first + 1);
+    lights.clearFrameChanged();
+  }
+}
+
 
 //================================================================================
 // Mode Management
 //================================================================================
 
 /*!
- * @brief changeRoutine Function that runs every loop iteration
- *        and determines how to light up the LEDs.
+ * @brief changeRoutine Draws the next step of the routine of a device right away.
+ *        The device's segment must already be selected.
  *
- * @param currentMode the current mode of the program
+ * @param device the index of the device to update
  */
-void changeRoutine(ERoutine currentMode)
+void changeRoutine(uint8_t device)
 {
-  switch (currentMode)
-  {
-    case eSingleSolid:
-      routines.singleSolid(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue);
-      break;
-
-    case eSingleBlink:
-      routines.singleBlink(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue);
-      break;
-
-    case eSingleWave:
-      routines.singleWave(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue);
-      break;
-
-    case eSingleGlimmer:
-      routines.singleGlimmer(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue, single_glimmer_param);
-      break;
-
-    case eSingleFade:
-      routines.singleFade(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue, fade_param);
-      break;
-
-    case eSingleSawtoothFade:
-      routines.singleSawtoothFade(routines.mainColor().red, routines.mainColor().green, routines.mainColor().blue, sawtooth_param);
-      break;
-
-    case eMultiGlimmer:
-      routines.multiGlimmer(current_palette, multi_glimmer_param);
-      break;
-
-    case eMultiFade:
-      routines.multiFade(current_palette);
-      break;
-
-    case eMultiRandomSolid:
-      routines.multiRandomSolid(current_palette);
-      break;
+  const DeviceSettings& settings = devices[device];
+  // single color routines draw with the main color set by the routine packet
+  routines.runRoutine(settings.routine, settings.palette, routineParameter(settings));
+}
 
-    case eMultiRandomIndividual:
-      routines.multiRandomIndividual(current_palette);
-      break;
+/*!
+ * @brief advanceRoutine Function that runs every loop iteration and moves the
+ *        routine of a device forward by the time that has passed. The device's
+ *        segment must already be selected.
+ *
+ * @param device the index of the device to update
+ * @param elapsed the milliseconds since the last loop
+ * @return true if the routine drew a new frame.
+ */
+bool advanceRoutine(uint8_t device, unsigned long elapsed)
+{
+  const DeviceSettings& settings = devices[device];
+  return routines.runRoutine(settings.routine, settings.palette, routineParameter(settings), elapsed);
+}
 
-    case eMultiBars:
-      routines.multiBars(current_palette, multi_bars_param);
-      break;
+/*!
+ * @brief speedToStepInterval Converts a speed value into the milliseconds each step of
+ *        a routine takes. Higher speeds take shorter steps.
+ *
+ * @param speed the speed, between 1 and MAX_SPEED_VALUE.
+ */
+uint16_t speedToStepInterval(int speed)
+{
+  return ((MAX_SPEED_VALUE + 5) - speed) * STEP_TIME_UNIT;
+}
 
-    default:
-      break;
-  }
+/*!
+ * @brief routineParameter Retrieves the setting of a device's routine, such as the
+ *        glimmer percent or the bar size, for routines that take one.
+ *
+ * @param settings the settings of the device
+ */
+int routineParameter(const DeviceSettings& settings)
+{
+  if (settings.routine == eSingleGlimmer)      return settings.single_glimmer_param;
+  if (settings.routine == eSingleFade)         return settings.fade_param;
+  if (settings.routine == eSingleSawtoothFade) return settings.sawtooth_param;
+  if (settings.routine == eMultiGlimmer)       return settings.multi_glimmer_param;
+  if (settings.routine == eMultiBars)          return settings.multi_bars_param;
+  if (settings.routine >= eRoutine_MAX)        return settings.custom_param;
+  return 0;
 }
 
 //================================================================================
@@ -430,12 +542,15 @@ bool parsePacket(int header)
       if (int_array_size == 3) {
         success = true;
         received_hardware_index = packet_int_array[1];
-        if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-          if (packet_int_array[2] == 0) {
-            routines.turnOff();
-          } else if (packet_int_array[2] == 1) {
-            loop_counter = 0;
-            routines.turnOn();
+        for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+          if (isAddressed(device)) {
+            routines.selectSegment(device);
+            if (packet_int_array[2] == 0) {
+              routines.turnOff();
+            } else if (packet_int_array[2] == 1) {
+              devices[device].should_update_no_speed = true;
+              routines.turnOn();
+            }
           }
         }
       }
@@ -448,15 +563,21 @@ bool parsePacket(int header)
         int color_index = packet_int_array[2];
         if (color_index >= 0 && color_index < eRoutine_MAX) {
           success = true;
-
-          // only tell the routines to reset themselves if a custom routine is used.
-          if ((current_routine > eSingleSawtoothFade)
-              && (current_palette == eCustom)) {
-            // Reset LEDS
-            loop_counter = 0;
-          }
           received_hardware_index = packet_int_array[1];
-          if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
+          // the custom colors are shared by every device
+          bool addressed = false;
+          for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+            if (isAddressed(device)) {
+              addressed = true;
+              // only tell the routines to reset themselves if a custom routine is used.
+              if (routines.isMultiColor(devices[device].routine)
+                  && (devices[device].palette == eCustom)) {
+                // Reset LEDS
+                devices[device].should_update_no_speed = true;
+              }
+            }
+          }
+          if (addressed) {
             routines.setColor(color_index,
                               packet_int_array[3],
                               packet_int_array[4],
@@ -471,12 +592,17 @@ bool parsePacket(int header)
           success = true;
           int param = constrain(packet_int_array[2], 0, 100);
           received_hardware_index = packet_int_array[1];
-          // update brightness level
-          if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-            if (param != routines.brightness()) { 
-              should_update_no_speed = true; 
-              routines.brightness(param); 
-            } 
+          // the brightness is shared by every device, so all of them are updated
+          // when it changes.
+          bool addressed = false;
+          for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+            addressed = addressed || isAddressed(device);
+          }
+          if (addressed && (param != routines.brightness())) {
+            routines.brightness(param);
+            for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+              devices[device].should_update_no_speed = true;
+            }
           }
         }
         break;
@@ -485,9 +611,11 @@ bool parsePacket(int header)
       if (int_array_size == 3) {
         success = true;
         received_hardware_index = packet_int_array[1];
-        if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-          unsigned long new_timeout = (unsigned long)packet_int_array[2];
-          idle_timeout = new_timeout * 60 * 1000;
+        for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+          if (isAddressed(device)) {
+            unsigned long new_timeout = (unsigned long)packet_int_array[2];
+            devices[device].idle_timeout = new_timeout * 60 * 1000;
+          }
         }
       }
       break;
@@ -496,12 +624,30 @@ bool parsePacket(int header)
         if (packet_int_array[2] > 1) {
           success = true;
           received_hardware_index = packet_int_array[1];
-          if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
+          // the custom colors are shared by every device
+          bool addressed = false;
+          for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+            addressed = addressed || isAddressed(device);
+          }
+          if (addressed) {
             routines.setCustomColorCount(packet_int_array[2]);
           }
         }
       }
       break;
+    case eRealtimeFrame:
+      if (int_array_size >= 5) {
+        // the values are bytes, so they are packed the way a binary message sends them
+        uint8_t data[max_number_of_ints - 1];
+        uint8_t count = int_array_size - 1;
+        bool inRange = true;
+        for (uint8_t i = 0; i < count; ++i) {
+          inRange = inRange && (packet_int_array[i + 1] >= 0) && (packet_int_array[i + 1] <= 255);
+          data[i] = packet_int_array[i + 1];
+        }
+        success = inRange && drawRealtimeFrame(data, count);
+      }
+      break;
     case eStateUpdateRequest:
       if (int_array_size == 1) {
         skip_echo = true;
@@ -513,7 +659,7 @@ bool parsePacket(int header)
     case eCustomArrayUpdateRequest:
       if (int_array_size == 1) {
         skip_echo = true;
-        // Send back update
+        // Send back an update for each device
         buildCustomArrayUpdatePacket();
         client.print(state_update_packet);
       }
@@ -524,11 +670,107 @@ bool parsePacket(int header)
   return success;
 }
 
+/*!
+ * @brief drawRealtimeFrame draws the colors of a realtime frame message on each device it
+ *        addresses, in place of their routines. A device fades into its first frame, and
+ *        the frames aren't echoed.
+ *
+ * @param data the values of the message after its header: the hardware index, the first
+ *        LED as two bytes, least significant first, an ERealtimeEncoding, and the colors.
+ * @param count the number of values.
+ * @return true if the message was valid.
+ */
+bool drawRealtimeFrame(const uint8_t* data, uint8_t count)
+{
+  if ((count < 4) || (data[3] >= eRealtimeEncoding_MAX)) {
+    return false;
+  }
+  received_hardware_index = data[0];
+  uint16_t first = data[1] | ((uint16_t)data[2] << 8);
+  uint8_t encoding = data[3];
+  const uint8_t* colors = data + 4;
+  uint8_t size = count - 4;
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    if (!isAddressed(device)) {
+      continue;
+    }
+    routines.selectSegment(device);
+    if (!devices[device].realtime) {
+      devices[device].realtime = true;
+      routines.startTransition(TRANSITION_TIME);
+    }
+    devices[device].realtime_time = millis();
+    // counted past the end of the segment, where the LEDs are skipped
+    uint32_t led = first;
+    uint8_t i = 0;
+    if (encoding == eRealtimeRaw) {
+      routines.drawColors(led, size / 3, colors, 3);
+    } else if (encoding == eRealtimeRun) {
+      while ((i + 4 <= size) && (led < routines.ledCount())) {
+        routines.drawColors(led, colors[i], colors + i + 1, 0);
+        led += colors[i];
+        i += 4;
+      }
+    } else {
+      // the LEDs that are skipped keep the color of the last frame
+      while ((i + 2 <= size) && (led < routines.ledCount())) {
+        led += colors[i];
+        uint8_t length = colors[i + 1];
+        i += 2;
+        if (i + length * 3 > size) {
+          break;
+        }
+        if (led < routines.ledCount()) {
+          routines.drawColors(led, length, colors + i, 3);
+        }
+        led += length;
+        i += length * 3;
+      }
+    }
+  }
+  skip_echo = true;
+  return true;
+}
+
+/*!
+ * @brief realtimeTimedOut checks if a device showing realtime frames has gone without one
+ *        for too long, and if it has, fades it back into its routine. The device's segment
+ *        must already be selected.
+ *
+ * @param device the index of the device.
+ * @param now the time of the current loop.
+ * @return true if the device went back to its routine.
+ */
+bool realtimeTimedOut(uint8_t device, unsigned long now)
+{
+  if ((REALTIME_TIMEOUT == 0) || (now - devices[device].realtime_time < (unsigned long)REALTIME_TIMEOUT)) {
+    return false;
+  }
+  devices[device].realtime = false;
+  routines.startTransition(TRANSITION_TIME);
+  // the routine draws its frame again from its start, since the realtime frames drew over
+  // it and routines such as multiRandomSolid only draw on some of their steps
+  routines.restartRoutine();
+  devices[device].should_update_no_speed = true;
+  return true;
+}
+
+/*!
+ * @brief isAddressed checks if the received hardware index addresses a device.
+ *        A hardware index of 0 addresses every device.
+ *
+ * @param device the index of the device.
+ */
+bool isAddressed(uint8_t device)
+{
+  return (received_hardware_index == 0)
+         || (received_hardware_index == hardware_index + device);
+}
 
 /*!
  * @brief routineParser Parses a routine packet, checking that the received packets are the proper
  *        size and that their values fall into the proper ranges. If they do, this function sets
- *        the values in memory.
+ *        the values in memory for every device the packet addresses.
  *        
  * @param currentSuccess the current success status of the packet parsing. This will only ever
  *        set the success packet to true
@@ -539,27 +781,25 @@ bool routineParser(bool currentSuccess)
   // check theres at least enough information to get a routine and hardware index
   // and check if routine is in a valid range
   if (int_array_size > 2) {
-      if ((packet_int_array[2] < (int)eRoutine_MAX)
+      if ((packet_int_array[2] >= 0)
+           && (packet_int_array[2] < (int)eRoutine_MAX + CUSTOM_ROUTINE_COUNT)
            && (packet_int_array[1] <= (DEFAULT_HW_INDEX + DEVICE_COUNT - 1))) {
       // required values
       received_hardware_index = packet_int_array[1];
-      ERoutine routine        = (ERoutine)packet_int_array[2];
+      uint8_t routine         = packet_int_array[2];
       bool isValid            = false;
-      reset_counter           = false;
   
       // routine specific values
       EPalette palette        = ePalette_MAX;
       int speedValue          = 0;
+      int param               = 0;
 
       // check that packets are the correct size and fill in parameters
-      // check if loop counter should reset
       switch (routine) {
         case eSingleSolid:
         {
           if (int_array_size == 6) {
-            isValid = parseColor(packet_int_array[3],
-                                 packet_int_array[4],
-                                 packet_int_array[5]);
+            isValid = isColorValid();
           }
           break;
         }
@@ -568,15 +808,7 @@ bool routineParser(bool currentSuccess)
         {
           if (int_array_size == 7) {
             speedValue = packet_int_array[6];
-            if (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE) {
-              isValid = parseColor(packet_int_array[3],
-                                   packet_int_array[4],
-                                   packet_int_array[5]);           
-            }
-            // check if reset counter
-            if (routine != current_routine) {
-              reset_counter = true;            
-            }
+            isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE) && isColorValid();
           }
           break;
         }
@@ -586,50 +818,12 @@ bool routineParser(bool currentSuccess)
         {
           if (int_array_size == 8) {
             speedValue = packet_int_array[6];
-
-            // handle the optional parameters
-            if (routine == eSingleFade) {
-              if (speedValue >= 0 
-                  && speedValue <= MAX_SPEED_VALUE
-                  && packet_int_array[7] <= 1) {
-                isValid = parseColor(packet_int_array[3],
-                                     packet_int_array[4],
-                                     packet_int_array[5]);
-                if (packet_int_array[7] != fade_param) {
-                  fade_param = packet_int_array[7];
-                  reset_counter = true;            
-                }
-              }
-            } else if (routine == eSingleSawtoothFade) {
-              if (speedValue >= 0 
-                  && speedValue <= MAX_SPEED_VALUE
-                  && packet_int_array[7] <= 1) {
-                isValid = parseColor(packet_int_array[3],
-                                     packet_int_array[4],
-                                     packet_int_array[5]);
-                if (packet_int_array[7] != sawtooth_param) {
-                  sawtooth_param = packet_int_array[7];
-                  reset_counter = true;            
-                }
-              }
-            } else if (routine == eSingleGlimmer) {
-               if (speedValue >= 0 
-                  && speedValue <= MAX_SPEED_VALUE
-                  && packet_int_array[7] <= 100) {
-                isValid = parseColor(packet_int_array[3],
-                                     packet_int_array[4],
-                                     packet_int_array[5]);
-                if (packet_int_array[7] != single_glimmer_param) {
-                  single_glimmer_param = packet_int_array[7];
-                  reset_counter = true;            
-                }
-              }
-            }
-
-            // check if reset counter
-            if (routine != current_routine) {
-              reset_counter = true;            
-            }
+            param = packet_int_array[7];
+            // glimmer takes a percent, the fades take a bool
+            int maxParam = (routine == eSingleGlimmer) ? 100 : 1;
+            isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE)
+                      && (param >= 0 && param <= maxParam)
+                      && isColorValid();
           }
           break;
         } 
@@ -639,36 +833,11 @@ bool routineParser(bool currentSuccess)
           if (int_array_size == 6) {
             palette = (EPalette)packet_int_array[3];
             speedValue = packet_int_array[4];
-            isValid = true;
-  
-            if (routine == eMultiGlimmer) {
-              if (speedValue >= 0 
-                  && speedValue <= MAX_SPEED_VALUE
-                  && packet_int_array[5] <= 100) {
-                 isValid = true;
-                 if (packet_int_array[5] != multi_glimmer_param) {
-                    multi_glimmer_param = packet_int_array[5];
-                    reset_counter = true;            
-                 }
-               }
-             } else if (routine == eMultiBars) {
-               if (speedValue >= 0 
-                  && speedValue <= MAX_SPEED_VALUE
-                  && packet_int_array[5] <= 10) {
-                 isValid = true;
-                 if (packet_int_array[5] != multi_bars_param) {
-                   multi_bars_param = packet_int_array[5];
-                   reset_counter = true;            
-                }
-              }
-            }
-            if (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE) {
-              isValid = true;
-              // check if reset counter
-              if (palette != current_palette || routine != current_routine) {
-                reset_counter = true;            
-              }
-            }
+            param = packet_int_array[5];
+            // glimmer takes a percent, bars take a bar size
+            int maxParam = (routine == eMultiGlimmer) ? 100 : 10;
+            isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE)
+                      && (param >= 0 && param <= maxParam);
           }
           break;
         }
@@ -679,46 +848,37 @@ bool routineParser(bool currentSuccess)
           if (int_array_size == 5) {
             palette = (EPalette)packet_int_array[3];
             speedValue = packet_int_array[4];
-
-            if (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE) {
-              isValid = true;
-              // check if reset counter
-              if (palette != current_palette || routine != current_routine) {
-                reset_counter = true;            
-              }
-            }
+            isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE);
           }
           break;
         }
         default:
+        {
+          // routines added by the sketch take the packet of the glimmer routine of their kind
+          if (routines.isMultiColor(routine)) {
+            if (int_array_size == 6) {
+              palette = (EPalette)packet_int_array[3];
+              speedValue = packet_int_array[4];
+              param = packet_int_array[5];
+              isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE) && (param >= 0);
+            }
+          } else if (int_array_size == 8) {
+            speedValue = packet_int_array[6];
+            param = packet_int_array[7];
+            isValid = (speedValue >= 0 && speedValue <= MAX_SPEED_VALUE)
+                      && (param >= 0)
+                      && isColorValid();
+          }
           break;
+        }
       }
-      // if the packet was valid, do some final checks
+      // if the packet was valid, update the stored values of each device it addresses
       if (isValid) {
-        // update stored values
-        if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-          if (routine == eSingleSolid) {
-            // check reset counter
-            if (routine != current_routine) {
-              reset_counter = true;            
-            }
-            current_routine = routine;
-          } else if ((speedValue >= 0 && speedValue <= MAX_SPEED_VALUE)) {
-            update_speed = speedValue;
-            current_routine = routine;
-            if (routine > eSingleSawtoothFade) {
-              current_palette = palette;
-            }
+        for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+          if (isAddressed(device)) {
+            updateDevice(device, routine, palette, speedValue, param);
           }
         }
-        
-        if (reset_counter) {
-          // Reset to 0 to draw to screen right away
-          loop_counter = 0;
-          if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-            should_update_no_speed = true;            
-          }
-        }     
         success = true;
       }
     } 
@@ -726,23 +886,84 @@ bool routineParser(bool currentSuccess)
   return success;
 }
 
-bool parseColor(int red, int green, int blue) {
-  bool success = false;
-  // first check if the values are in a valid range
-  if (red >= 0 && red <= 255
-      || green >= 0 && green <= 255
-      || blue >= 0 && blue <= 255) {
-      if ((received_hardware_index == hardware_index) || (received_hardware_index == 0)) {
-        if (red != routines.mainColor().red
-            || green != routines.mainColor().green
-            || blue  != routines.mainColor().blue) {
-          reset_counter = true;
-          routines.setMainColor(red, green, blue);
-        }
-      }
-    success = true;
+/*!
+ * @brief isColorValid checks that the color of a single color routine packet, stored in 
+ *        the fourth through sixth values of the packet, is in a valid range.
+ */
+bool isColorValid()
+{
+  return (packet_int_array[3] >= 0 && packet_int_array[3] <= 255)
+         && (packet_int_array[4] >= 0 && packet_int_array[4] <= 255)
+         && (packet_int_array[5] >= 0 && packet_int_array[5] <= 255);
+}
+
+/*!
+ * @brief updateDevice stores the values of a valid routine packet for a device. If
+ *        anything has changed, the device draws its next frame right away.
+ *
+ * @param device the index of the device.
+ * @param routine the new routine.
+ * @param palette the new palette, only used by multi color routines.
+ * @param speedValue the new speed, not used by eSingleSolid.
+ * @param param the routine specific parameter, if the routine has one.
+ */
+void updateDevice(uint8_t device, uint8_t routine, EPalette palette, int speedValue, int param)
+{
+  DeviceSettings& settings = devices[device];
+  routines.selectSegment(device);
+  bool shouldReset = (routine != settings.routine);
+  if (shouldReset && !settings.realtime) {
+    // fade from the frame of the old routine, before anything is drawn with the new one
+    routines.startTransition(TRANSITION_TIME);
+  }
+
+  if (!routines.isMultiColor(routine)) {
+    // single color routines draw with the main color
+    if (routines.setMainColor(packet_int_array[3],
+                              packet_int_array[4],
+                              packet_int_array[5])) {
+      shouldReset = true;
+    }
+  } else if (palette != settings.palette) {
+    settings.palette = palette;
+    shouldReset = true;
+  }
+
+  // check if the routine specific parameter changed
+  int* storedParam = 0;
+  if (routine == eSingleGlimmer) {
+    storedParam = &settings.single_glimmer_param;
+  } else if (routine == eMultiGlimmer) {
+    storedParam = &settings.multi_glimmer_param;
+  } else if (routine == eMultiBars) {
+    storedParam = &settings.multi_bars_param;
+  } else if (routine >= eRoutine_MAX) {
+    storedParam = &settings.custom_param;
+  }
+  if (storedParam && (*storedParam != param)) {
+    *storedParam = param;
+    shouldReset = true;
+  }
+  if ((routine == eSingleFade) && (settings.fade_param != (bool)param)) {
+    settings.fade_param = param;
+    shouldReset = true;
+  }
+  if ((routine == eSingleSawtoothFade) && (settings.sawtooth_param != (bool)param)) {
+    settings.sawtooth_param = param;
+    shouldReset = true;
+  }
+
+  settings.routine = routine;
+  if ((routine != eSingleSolid) && (speedValue != settings.update_speed)) {
+    settings.update_speed = speedValue;
+    if (speedValue != 0) {
+      routines.stepInterval(speedToStepInterval(speedValue));
+    }
+  }
+  if (shouldReset) {
+    // draw to screen right away
+    settings.should_update_no_speed = true;
   }
-  return success;
 }
 
 
@@ -750,231 +971,257 @@ bool parseColor(int red, int green, int blue) {
 // State Update
 //================================================================================
 
+/*!
+ * @brief buildStateUpdatePacket builds the state update of every device, unless the
+ *        packet already holds it and none of its values changed.
+ */
 void buildStateUpdatePacket() 
 {
-  memset(state_update_packet, 0, sizeof(state_update_packet));
-
-  strcat(state_update_packet, itoa((uint8_t)eStateUpdateRequest, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)hardware_index, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)routines.isOn(), num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(1, num_buf, 10)); // isReachable
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(routines.mainColor().red, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(routines.mainColor().green, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(routines.mainColor().blue, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)current_routine, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)current_palette, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(routines.brightness(), num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(update_speed, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(idle_timeout / 60000, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa(calculateMinutesUntilTimeout(last_message_time, idle_timeout), num_buf, 10));
-  strcat(state_update_packet, message_delimiter);
-
-
-  // add the crc
-  if (USE_CRC) {
-    unsigned long crc = crcCalculator(state_update_packet);
-    strcat(state_update_packet, crc_delimiter);
-    strcat(state_update_packet, ultoa(crc, num_buf, 10));
-    strcat(state_update_packet, message_delimiter);
-   }  
+  startReply();
+  // one message for each device
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    routines.selectSegment(device);
+    addReplyValue(eStateUpdateRequest);
+    addReplyValue(hardware_index + device);
+    addReplyValue(routines.isOn());
+    addReplyValue(1); // isReachable
+    addReplyValue(routines.mainColor().red);
+    addReplyValue(routines.mainColor().green);
+    addReplyValue(routines.mainColor().blue);
+    addReplyValue(devices[device].routine);
+    addReplyValue(devices[device].palette);
+    addReplyValue(routines.brightness());
+    addReplyValue(devices[device].update_speed);
+    addReplyValue(devices[device].idle_timeout / 60000);
+    addReplyValue(calculateMinutesUntilTimeout(last_message_time, devices[device].idle_timeout));
+  }
+  if (!replyChanged()) {
+    return;
+  }
 
+  char* cursor = state_update_packet;
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    cursor = writeMessage(cursor, reply_values + device * 13, 13);
+  }
+  writePacketEnd(state_update_packet, cursor);
 }
 
-
+/*!
+ * @brief buildCustomArrayUpdatePacket builds the custom array update of every device,
+ *        each in its own packet, unless the packet already holds them and none of their
+ *        values changed. The custom colors are shared by every device, so only the
+ *        hardware index differs.
+ */
 void buildCustomArrayUpdatePacket() 
 {
-  memset(state_update_packet, 0, sizeof(state_update_packet));
-
-  strcat(state_update_packet, itoa((uint8_t)eCustomArrayUpdateRequest, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)hardware_index, num_buf, 10));
-  strcat(state_update_packet, value_delimiter);
-  strcat(state_update_packet, itoa((uint8_t)routines.customColorCount(), num_buf, 10));
+  startReply();
+  addReplyValue(eCustomArrayUpdateRequest);
+  addReplyValue(hardware_index);
+  addReplyValue(routines.customColorCount());
   for (int i = 0; i < routines.customColorCount(); ++i) {
-    strcat(state_update_packet, value_delimiter);
-    strcat(state_update_packet, itoa(routines.color(i).red, num_buf, 10));
-    strcat(state_update_packet, value_delimiter);
-    strcat(state_update_packet, itoa(routines.color(i).green, num_buf, 10));
-    strcat(state_update_packet, value_delimiter);
-    strcat(state_update_packet, itoa(routines.color(i).blue, num_buf, 10));
+    addReplyValue(routines.color(i).red);
+    addReplyValue(routines.color(i).green);
+    addReplyValue(routines.color(i).blue);
+  }
+  if (!replyChanged()) {
+    return;
   }
-  strcat(state_update_packet, message_delimiter);
-
-  // add the crc
-  if (USE_CRC) {
-    unsigned long crc = crcCalculator(state_update_packet);
-    strcat(state_update_packet, crc_delimiter);
-    strcat(state_update_packet, ultoa(crc, num_buf, 10));
-    strcat(state_update_packet, message_delimiter);
-  }  
 
+  char* cursor = state_update_packet;
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    char* packet = cursor;
+    cursor = writeNumber(cursor, eCustomArrayUpdateRequest);
+    cursor = writeText(cursor, value_delimiter);
+    cursor = writeNumber(cursor, hardware_index + device);
+    cursor = writeText(cursor, value_delimiter);
+    cursor = writeMessage(cursor, reply_values + 2, reply_value_count - 2);
+    cursor = writePacketEnd(packet, cursor);
+  }
 }
 
-
 void buildDiscoveryPacket()
 {
-  strcat(discovery_packet, "DISCOVERY_PACKET");
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)API_LEVEL_MAJOR, num_buf, 10));
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)API_LEVEL_MINOR, num_buf, 10));
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)USE_CRC, num_buf, 10));
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)0, num_buf, 10)); // Hardware Capabilities flag (0 for arduino, 1 for raspberry pi)
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)max_packet_size, num_buf, 10));
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)DEVICE_COUNT, num_buf, 10));
-  strcat(discovery_packet, names_delimiter);
-  strcat(discovery_packet, name_buffer);
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)light_type, num_buf, 10));
-  strcat(discovery_packet, value_delimiter);
-  strcat(discovery_packet, itoa((uint8_t)product_type, num_buf, 10));
-  strcat(discovery_packet, message_delimiter);
+  char* cursor = writeText(discovery_packet, "DISCOVERY_PACKET");
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, API_LEVEL_MAJOR);
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, API_LEVEL_MINOR);
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, USE_CRC);
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, CAPABILITIES); // Hardware Capabilities flags, see ECapability
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, max_packet_size);
+  cursor = writeText(cursor, value_delimiter);
+  cursor = writeNumber(cursor, DEVICE_COUNT);
+  cursor = writeText(cursor, names_delimiter);
+  for (uint8_t device = 0; device < DEVICE_COUNT; ++device) {
+    if (device > 0) {
+      cursor = writeText(cursor, value_delimiter);
+    }
+    cursor = writeText(cursor, name_buffer);
+    if (device > 0) {
+      // devices after the first are numbered from 2
+      cursor = writeText(cursor, " ");
+      cursor = writeNumber(cursor, device + 1);
+    }
+    cursor = writeText(cursor, value_delimiter);
+    cursor = writeNumber(cursor, light_type);
+    cursor = writeText(cursor, value_delimiter);
+    cursor = writeNumber(cursor, product_type);
+  }
+  cursor = writeText(cursor, message_delimiter);
 
 }
 
-void echoPacket()
-{  
-  // add the crc
-  if (USE_CRC) {
-    unsigned long crc = crcCalculator(echo_message);
-    strcat(echo_message, crc_delimiter);
-    strcat(echo_message, ultoa(crc, num_buf, 10));
-    strcat(echo_message, message_delimiter);
-   }  
-  
-  client.print(echo_message); 
+/*!
+ * @brief startReply starts comparing the values of a reply with the ones the packet in
+ *        state_update_packet was built from.
+ */
+void startReply()
+{
+  reply_value_index = 0;
+  reply_changed = false;
 }
 
-unsigned long calculateMinutesUntilTimeout(unsigned long last_message, unsigned long timeout_max) {
-  if (timeout_max == 0) {
-    // will never timeout as this is disabled, jsut return 1.
-    return 1;
-  } else if (last_message + timeout_max < millis()) {
-    // already timed out.
-    return 0;
-  } else {
-    // we truncate the value so a +1 is added so that when theres less than a minute its not treated as already timed out.
-    return ((timeout_max + last_message - millis()) / 60000) + 1;
+/*!
+ * @brief addReplyValue adds the next value of a reply, and notes if it differs from the
+ *        value in the same place of the packet that was built last.
+ *
+ * @param value the value.
+ */
+void addReplyValue(int value)
+{
+  if ((reply_value_index >= reply_value_count)
+      || (reply_values[reply_value_index] != value)) {
+    reply_values[reply_value_index] = value;
+    reply_changed = true;
   }
+  ++reply_value_index;
 }
 
+/*!
+ * @brief replyChanged checks if any value of a reply differs from the packet that was
+ *        built last, so the packet needs to be built again.
+ *
+ * @return true if the packet is out of date, false if it can be sent as it is.
+ */
+bool replyChanged()
+{
+  reply_changed = reply_changed || (reply_value_index != reply_value_count);
+  reply_value_count = reply_value_index;
+  return reply_changed;
+}
 
 //================================================================================
-// String Parsing
+// Packet Writing
 //================================================================================
+// Packets are written at a cursor that is moved past everything written, so nothing is
+// scanned again to find the end of the packet. The text is kept null terminated.
+
+/*!
+ * @brief writeText writes text at the cursor.
+ *
+ * @param cursor where the text is written.
+ * @param text the text.
+ * @return the cursor after the text.
+ */
+char* writeText(char* cursor, const char* text)
+{
+  while (*text != 0) {
+    *cursor++ = *text++;
+  }
+  *cursor = 0;
+  return cursor;
+}
 
 /*!
- * @brief checkIfPacketIsValid takes a char array as input and determines if  
- *        it contains the proper characters. If CRC is enabled, it also runs the
- *        CRC check. This function does not modify the char array in any way. 
+ * @brief writeNumber writes a number at the cursor.
  *
- * @param message the input char array.
+ * @param cursor where the number is written.
+ * @param value the number.
+ * @return the cursor after the number.
+ */
+char* writeNumber(char* cursor, int value)
+{
+  return writeText(cursor, itoa(value, num_buf, 10));
+}
+
+/*!
+ * @brief writeMessage writes values as a message at the cursor.
  *
- * @return true if the string was parseable and passes CRC, false otherwise.
+ * @param cursor where the message is written.
+ * @param values the values of the message.
+ * @param count the number of values.
+ * @return the cursor after the "&" at the end of the message.
  */
-bool checkIfPacketIsValid(char* message)
+char* writeMessage(char* cursor, const int* values, uint8_t count)
 {
-  bool isValid = true;
-
-  //-----
-  // Validity check
-  //-----
-  // check if it contains only valid characters
-  int hashCount = 0;
-  int i = 0;
-  while(message[i] != 0) {
-    if (!(isdigit(message[i])
-          || message[i] == ','
-          || message[i] == '&'
-          || message[i] == '#'
-          || message[i] == '-')) {
-      isValid = false;
+  for (uint8_t i = 0; i < count; ++i) {
+    if (i > 0) {
+      cursor = writeText(cursor, value_delimiter);
     }
-  
-    // # is only used in CRCs, and a valid message
-    // can only have one. 
-    if (message[i] == '#') {
-      if (USE_CRC) {
-        // count number of #
-        hashCount++;
-      } else {
-        // This should not be valid as its used for CRC only
-        isValid = false;
-      }
-    }  
-    ++i;
+    cursor = writeNumber(cursor, values[i]);
   }
+  return writeText(cursor, message_delimiter);
+}
 
-  //-----
-  // Early failures check
-  //-----
-  // exit early if packet is not valid. 
-  if ((USE_CRC && (hashCount != 1)) // CRC packets must have one #
-      || (isValid == false)) {
-    return false;
-  }
-  
-  //-----
-  // CRC check
-  //-----
+/*!
+ * @brief writePacketEnd ends the messages of a packet with their CRC, and for serial
+ *        with the end of the packet and the newline.
+ *
+ * @param packet the start of the packet.
+ * @param cursor the end of its messages.
+ * @return the cursor after the end of the packet.
+ */
+char* writePacketEnd(const char* packet, char* cursor)
+{
+  // add the crc
   if (USE_CRC) {
-    // get a char array of the payload
-    char* payload = strtok(message, "#");
-    // get a char array of the CRC
-    char* crcASCII = strtok(0, "&");
-    // compute the CRC of the full packet
-    unsigned long computedCRC = crcCalculator(message);
-    // grab the unsigned long value of the crc
-    unsigned long givenCRC = strtoul(crcASCII, NULL, 0);
-    if (computedCRC == givenCRC) {
-      // using CRC, computed CRC matches given
-      return true;
-    } else {
-      // using CRC, computed CRC matches given
-      return false;
-    }
-  } else {
-    // valid but not using CRC, return true
-    return true;
+    uint32_t crc = ArduCorParser::crc(packet);
+    cursor = writeText(cursor, crc_delimiter);
+    cursor = writeText(cursor, ultoa(crc, num_buf, 10));
+    cursor = writeText(cursor, message_delimiter);
   }
+  return cursor;
 }
 
 /*!
- *  @brief delimitedStringToIntArray takes a char array and fills the packet_int_array
- *         variable with the integer representation of these packets. By this point in message parsing,
- *         it is already confirmed that the messages contain only digits and "," characters, as the char
- *         array has passed its CRC check and has been converted into a single message and has had its "&"
- *         stripped away. This is a destructive operation and the char array cannot be used after it. 
- *
- * @param message the input string.
+ * @brief echoPacket sends a message back to the sender straight from the packet it
+ *        arrived in, as its own packet.
  *
+ * @param message the start of the message.
+ * @param length the number of characters of the message, without its "&".
  */
-void delimitedStringToIntArray(char* message)
+void echoPacket(const char* message, uint8_t length)
 {
-  int_array_size = 0;
-  // Get the frist substring delimited by a ","
-  char* valuePtr = strtok(message, ",");
-  while (valuePtr != 0) {
-    // convert chars to int and story in int array.
-    packet_int_array[int_array_size] = atoi(valuePtr);
-    int_array_size++;
-    // Find the next substring delimited by a ","
-    valuePtr = strtok(0, ",");
-  } 
+  // add the crc, which includes the "&" after the message
+  uint32_t crc = ~(uint32_t)0;
+  for (uint8_t i = 0; i < length; ++i) {
+    crc = ArduCorParser::crcUpdate(crc, message[i]);
+  }
+  crc = ~ArduCorParser::crcUpdate(crc, message_delimiter[0]);
+
+  client.write((const uint8_t*)message, length);
+  client.print(message_delimiter);
+  if (USE_CRC) {
+    client.print(crc_delimiter);
+    client.print(ultoa(crc, num_buf, 10));
+    client.print(message_delimiter);
+  }
+}
+
+unsigned long calculateMinutesUntilTimeout(unsigned long last_message, unsigned long timeout_max) {
+  if (timeout_max == 0) {
+    // will never timeout as this is disabled, jsut return 1.
+    return 1;
+  } else if (last_message + timeout_max < millis()) {
+    // already timed out.
+    return 0;
+  } else {
+    // we truncate the value so a +1 is added so that when theres less than a minute its not treated as already timed out.
+    return ((timeout_max + last_message - millis()) / 60000) + 1;
+  }
 }
+
+
@@ -23,8 +23,12 @@ const int  LED_COUNT         = 64;     // the number of LEDs controlled by your
 //=======================
 // ArduCor Setup
 //=======================
-// Library used to generate the RGB LED routines.
-ArduCor routines = ArduCor(LED_COUNT);
+// Library used to generate the RGB LED routines. Its buffers are sized by LED_COUNT
+// when the sketch is compiled, so they count towards the memory the IDE reports.
+StaticArduCor<LED_COUNT> routines;
+
+// time of the last loop, the routine moves forward by the time since then.
+unsigned long lastFrameTime = 0;
 
 
 //================================================================================
@@ -46,51 +50,64 @@ void setup()
   // It expects a value between 0 and 100. 0 means off, 100 
   // means full brightness.
   routines.brightness(50);
+
+  // This sets how often the routines take a step, in milliseconds.
+  // Every half a second, the glimmer picks new LEDs.
+  routines.stepInterval(500);
 }
 
 void loop()
 {
   /*!
-   * Each time a routines function is called, it updates the LEDs in the ArduCor library.
-   * This loop continually updates the ArduCor library, applies the brightness settings 
-   * from ArduCor, then updates the lighting hardware to show the new LED values.
+   * Each time a routine is run, it updates the LEDs in the ArduCor library. This loop
+   * continually moves the routine forward by the time that has passed, and when that
+   * draws a new frame, it applies the brightness settings from ArduCor, then updates the
+   * lighting hardware to show the new LED values.
    */
+  unsigned long now = millis();
+  unsigned long elapsed = now - lastFrameTime;
+  lastFrameTime = now;
   
   // the simple sample shows both a single and a multi color routine, 
   // set this flag to switch between them.
   bool useMultiColorRoutine = false;
   // For the glimmer routine, a parameter determines how many LEDs get the "glimmer" effect.
   const byte glimmerPercent = 15;
+  bool frameDrawn;
   if (useMultiColorRoutine) {
-      // if you're using the multi color routine, it'll fade between colors in the 
+      // if you're using the multi color routine, it'll glimmer with colors in the 
       // fire palette.
-      routines.multiGlimmer(eFire,  
-                            glimmerPercent); // percent of pixels to glimmer
+      frameDrawn = routines.runRoutine(eMultiGlimmer, 
+                                       eFire,
+                                       glimmerPercent, // percent of pixels to glimmer
+                                       elapsed);
   } else {
-     routines.singleGlimmer(routines.mainColor().red, 
-                            routines.mainColor().green, 
-                            routines.mainColor().blue,
-                            glimmerPercent); // percent of pixels to glimmer
+      // single color routines use the main color set in setup()
+      frameDrawn = routines.runRoutine(eSingleGlimmer,
+                                       eCustom,
+                                       glimmerPercent, // percent of pixels to glimmer
+                                       elapsed);
   }
      
-  routines.applyBrightness(); 
-  // updates the LED hardware with the values in the routines object.
-  updateLEDs(); 
-  // delay for half a second
-  delay(500);
+  if (frameDrawn) {
+    routines.applyBrightness(); 
+    // updates the LED hardware with the values in the routines object.
+    updateLEDs(); 
+  }
 }
 
 
 void updateLEDs()
 {
-  int index = 0;
+  // copy one row at a time, so only a small buffer is needed.
+  uint8_t row[8 * 3];
   for (int x = 0; x < 8; x++) {
+    routines.copyFrame(row, ArduCor::eOrderRGB, x * 8, 8);
     for (int y = 0; y < 8; y++)  {
       Rb.setPixelXY(x, y,
-                    routines.red(index),
-                    routines.green(index),
-                    routines.blue(index));
-      index++;
+                    row[y * 3],
+                    row[y * 3 + 1],
+                    row[y * 3 + 2]);
     }
   }
 }
@@ -55,7 +55,7 @@ PROJECT_DESCRIPTION=(
     " * Supports SeeedStudio Rainbowduino projects."
     " * Supports Adafruit NeoPixels products."
     " * Supports a single RGB LED but can be easily hacked to support more."
-    " * Example sketch with multiple ArduCor instances used"
+    " * Example sketch that splits one strip into segments that each run their own routine"
 )
 
 